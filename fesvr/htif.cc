@@ -180,6 +180,18 @@ const char* htif_t::get_symbol(uint64_t addr)
   return it->second.c_str();
 }
 
+bool htif_t::find_symbol(const char* name, uint64_t* addr)
+{
+  for (auto& it : addr2symbol) {
+    if (it.second == name) {
+      *addr = it.first;
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void htif_t::stop()
 {
   if (!sig_file.empty() && sig_len) // print final torture test signature
@@ -70,6 +70,15 @@ class htif_t : public chunked_memif_t
   // Given an address, return symbol from addr2symbol map
   const char* get_symbol(uint64_t addr);
 
+  // Given a symbol, find its address in the addr2symbol map
+  bool find_symbol(const char* name, uint64_t* addr);
+
+  // The files the target has open through the system call proxy
+  fds_t& target_fds() { return syscall_proxy.get_fds(); }
+
+  // End the run with the given exit code, as if the target had exited
+  void set_exit_code(int code) { exitcode = code << 1 | 1; }
+
  private:
   void parse_arguments(int argc, char ** argv);
   void register_devices();
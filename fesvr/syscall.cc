@@ -485,6 +485,62 @@ int fds_t::lookup(reg_t fd)
   return fd >= fds.size() ? -1 : fds[fd];
 }
 
+std::vector<fds_t::saved_fd_t> fds_t::save() const
+{
+  std::vector<saved_fd_t> saved(fds.size());
+  for (size_t i = 0; i < fds.size(); i++) {
+    saved[i].flags = -1;
+    saved[i].offset = 0;
+    if (fds[i] == -1)
+      continue;
+
+    char link[64], path[PATH_MAX];
+    snprintf(link, sizeof(link), "/proc/self/fd/%d", fds[i]);
+    ssize_t len = readlink(link, path, sizeof(path) - 1);
+    if (len > 0 && path[0] == '/') {
+      saved[i].path.assign(path, len);
+      saved[i].flags = fcntl(fds[i], F_GETFL);
+      saved[i].offset = lseek(fds[i], 0, SEEK_CUR);
+    }
+  }
+  return saved;
+}
+
+void fds_t::restore(const std::vector<saved_fd_t>& saved)
+{
+  if (fds.size() < saved.size())
+    fds.resize(saved.size(), -1);
+
+  for (size_t i = 0; i < saved.size(); i++) {
+    if (fds[i] != -1 || saved[i].path.empty())
+      continue;
+
+    int fd = open(saved[i].path.c_str(), saved[i].flags & ~(O_CREAT | O_EXCL | O_TRUNC));
+    if (fd < 0 || (saved[i].offset >= 0 && lseek(fd, saved[i].offset, SEEK_SET) < 0)) {
+      fprintf(stderr, "warning: can't reopen %s for target fd %zu\n", saved[i].path.c_str(), i);
+      if (fd >= 0)
+        close(fd);
+      continue;
+    }
+    fds[i] = fd;
+  }
+}
+
+void fds_t::unshare(const std::vector<saved_fd_t>& saved)
+{
+  for (size_t i = 0; i < saved.size() && i < fds.size(); i++) {
+    struct stat st;
+    if (saved[i].path.empty() || fds[i] == -1 || fstat(fds[i], &st) != 0 || !S_ISREG(st.st_mode))
+      continue;
+
+    int fd = open(saved[i].path.c_str(), saved[i].flags & ~(O_CREAT | O_EXCL | O_TRUNC));
+    if (fd < 0 || lseek(fd, saved[i].offset, SEEK_SET) < 0 || dup2(fd, fds[i]) < 0)
+      fprintf(stderr, "warning: can't reopen %s for target fd %zu\n", saved[i].path.c_str(), i);
+    if (fd >= 0)
+      close(fd);
+  }
+}
+
 void syscall_t::set_chroot(const char* where)
 {
   char buf1[PATH_MAX], buf2[PATH_MAX];
@@ -20,6 +20,22 @@ class fds_t
   reg_t alloc(int fd);
   void dealloc(reg_t fd);
   int lookup(reg_t fd);
+
+  // For checkpoints: the host file behind each fd, and reopening files so
+  // described.  The path is empty if the fd is closed, or if what it refers
+  // to (a pipe, say) has no path to reopen.
+  struct saved_fd_t {
+    std::string path;
+    int flags;
+    int64_t offset;
+  };
+  std::vector<saved_fd_t> save() const;
+  // fds that are already open (stdin, stdout and stderr) are left as they are
+  void restore(const std::vector<saved_fd_t>& saved);
+
+  // Reopen the regular files as saved, so that a process forked since
+  // then no longer shares their offsets with its parent
+  void unshare(const std::vector<saved_fd_t>& saved);
  private:
   std::vector<int> fds;
 };
@@ -30,6 +46,7 @@ class syscall_t : public device_t
   syscall_t(htif_t*);
 
   void set_chroot(const char* where);
+  fds_t& get_fds() { return fds; }
   
  private:
   const char* identity() { return "syscall_proxy"; }
@@ -0,0 +1,48 @@
+// See LICENSE for license details.
+
+#include "bbv.h"
+#include <cerrno>
+#include <cinttypes>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+bbv_profile_t::bbv_profile_t(const char* path, reg_t interval)
+  : interval(interval)
+{
+  file = fopen(path, "w");
+  if (!file)
+    throw std::runtime_error(std::string("can't create ") + path + ": " + strerror(errno));
+}
+
+bbv_profile_t::~bbv_profile_t()
+{
+  end_interval();
+  fclose(file);
+}
+
+uint32_t bbv_profile_t::lookup(reg_t pc)
+{
+  auto it = blocks.find(pc);
+  if (it != blocks.end())
+    return it->second;
+
+  uint32_t block = counts.size();
+  blocks[pc] = block;
+  counts.push_back(0);
+  return block;
+}
+
+void bbv_profile_t::end_interval()
+{
+  if (touched.empty())
+    return;
+
+  fputc('T', file);
+  for (uint32_t block : touched) {
+    fprintf(file, ":%" PRIu32 ":%" PRIu64 " ", block + 1, counts[block]);
+    counts[block] = 0;
+  }
+  fputc('\n', file);
+  touched.clear();
+}
@@ -0,0 +1,51 @@
+// See LICENSE for license details.
+#ifndef _RISCV_BBV_H
+#define _RISCV_BBV_H
+
+#include "decode.h"
+#include <stdio.h>
+#include <unordered_map>
+#include <vector>
+
+// A basic-block vector profile (--bbv), for SimPoint.  For every interval
+// of a hart's execution, one line gives the number of instructions it
+// executed in each basic block that it entered, in the format of
+// Valgrind's exp-bbv:
+//
+//   T:<block>:<instructions> :<block>:<instructions> ...
+//
+// Blocks are numbered from 1 in the order they are first entered, and are
+// told apart by the PC they start at.
+class bbv_profile_t
+{
+public:
+  // Throws std::runtime_error if path can't be created
+  bbv_profile_t(const char* path, reg_t interval);
+  // Writes out the last, partial, interval
+  ~bbv_profile_t();
+
+  static const uint32_t NO_BLOCK = -1;
+
+  reg_t get_interval() const { return interval; }
+
+  // The block starting at pc
+  uint32_t lookup(reg_t pc);
+
+  void count(uint32_t block, uint64_t insns)
+  {
+    if (insns && !counts[block])
+      touched.push_back(block);
+    counts[block] += insns;
+  }
+
+  void end_interval();
+
+private:
+  FILE* file;
+  reg_t interval;
+  std::unordered_map<reg_t, uint32_t> blocks;
+  std::vector<uint64_t> counts;
+  std::vector<uint32_t> touched; // blocks with counts this interval
+};
+
+#endif
@@ -0,0 +1,124 @@
+// See LICENSE for license details.
+
+#include "checkpoint.h"
+#include "mmu.h"
+#include <cerrno>
+#include <cstring>
+#include <stdexcept>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char magic[8] = {'S', 'P', 'I', 'K', 'E', 'C', 'K', 'P'};
+static const uint32_t version = 1;
+
+checkpoint_writer_t::checkpoint_writer_t(const char* path)
+  : path(path), offset(0)
+{
+  file = fopen(path, "wb");
+  if (!file)
+    throw std::runtime_error(std::string("can't create ") + path + ": " + strerror(errno));
+  write(magic, sizeof(magic));
+  write(version);
+}
+
+checkpoint_writer_t::~checkpoint_writer_t()
+{
+  if (file)
+    fclose(file);
+}
+
+void checkpoint_writer_t::write(const void* data, size_t len)
+{
+  if (fwrite(data, 1, len, file) != len)
+    throw std::runtime_error("error writing " + path + ": " + strerror(errno));
+  offset += len;
+}
+
+void checkpoint_writer_t::write_string(const std::string& s)
+{
+  write(uint64_t(s.size()));
+  write(s.data(), s.size());
+}
+
+void checkpoint_writer_t::align()
+{
+  static const char zeros[PGSIZE] = {};
+  write(zeros, (PGSIZE - offset % PGSIZE) % PGSIZE);
+}
+
+void checkpoint_writer_t::close()
+{
+  int err = fclose(file);
+  file = NULL;
+  if (err)
+    throw std::runtime_error("error writing " + path + ": " + strerror(errno));
+}
+
+checkpoint_reader_t::checkpoint_reader_t(const char* path)
+  : path(path), size(0), offset(0)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0)
+    throw std::runtime_error(std::string("can't open ") + path + ": " + strerror(errno));
+
+  struct stat st;
+  void* p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && st.st_size > 0) {
+    size = st.st_size;
+    p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  int err = errno;
+  ::close(fd);
+  if (p == MAP_FAILED)
+    throw std::runtime_error(std::string("can't map ") + path + ": " + strerror(err));
+
+  size_t len = size;
+  base = std::shared_ptr<char>((char*)p, [len](char* p) { munmap(p, len); });
+
+  char m[sizeof(magic)];
+  read(m, sizeof(m));
+  if (memcmp(m, magic, sizeof(magic)) != 0)
+    throw std::runtime_error(this->path + " is not a spike checkpoint");
+  if (read<uint32_t>() != version)
+    throw std::runtime_error(this->path + " was written by another version of spike");
+}
+
+void checkpoint_reader_t::check(size_t len)
+{
+  if (len > size - offset)
+    throw std::runtime_error(path + " is truncated");
+}
+
+void checkpoint_reader_t::read(void* data, size_t len)
+{
+  memcpy(data, map(len), len);
+}
+
+std::string checkpoint_reader_t::read_string()
+{
+  uint64_t len = read<uint64_t>();
+  return std::string(map(len), len);
+}
+
+void checkpoint_reader_t::read_tag(const char (&tag)[5])
+{
+  char t[4];
+  read(t, sizeof(t));
+  if (memcmp(t, tag, sizeof(t)) != 0)
+    throw std::runtime_error(path + " is corrupt (expected a " + tag + " section)");
+}
+
+void checkpoint_reader_t::align()
+{
+  offset = std::min(size, offset + (PGSIZE - offset % PGSIZE) % PGSIZE);
+}
+
+char* checkpoint_reader_t::map(size_t len)
+{
+  check(len);
+  char* p = base.get() + offset;
+  offset += len;
+  return p;
+}
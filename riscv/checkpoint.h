@@ -0,0 +1,86 @@
+// See LICENSE for license details.
+#ifndef _RISCV_CHECKPOINT_H
+#define _RISCV_CHECKPOINT_H
+
+#include "decode.h"
+#include <stdio.h>
+#include <memory>
+#include <string>
+#include <type_traits>
+
+// A checkpoint file (--save-checkpoint) holds the state of a whole machine:
+//
+//   checkpoint := "SPIKECKP" version config section*
+//   section    := tag data
+//
+// Each part of the machine writes its own sections, in a fixed order, with
+// save() and reads them back with restore().  Values are stored as they are
+// in memory, so a checkpoint is only meant to be restored by the spike that
+// wrote it, run with the same options; the config section guards against
+// obvious mismatches, and the tags against reading a section as another.
+// Memory pages start on PGSIZE boundaries in the file, so that restoring
+// can map them instead of reading them.
+//
+// Errors are reported by throwing std::runtime_error.
+class checkpoint_writer_t
+{
+public:
+  checkpoint_writer_t(const char* path);
+  ~checkpoint_writer_t();
+
+  void write(const void* data, size_t len);
+  template<class T> void write(const T& val)
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "not plain data");
+    write(&val, sizeof(val));
+  }
+  void write_string(const std::string& s);
+  void write_tag(const char (&tag)[5]) { write(tag, 4); }
+
+  // Pad to the next PGSIZE boundary
+  void align();
+
+  // Flush everything to the file
+  void close();
+
+private:
+  std::string path;
+  FILE* file;
+  size_t offset;
+};
+
+class checkpoint_reader_t
+{
+public:
+  checkpoint_reader_t(const char* path);
+
+  void read(void* data, size_t len);
+  template<class T> T read()
+  {
+    static_assert(std::is_trivially_copyable<T>::value, "not plain data");
+    T val;
+    read(&val, sizeof(val));
+    return val;
+  }
+  std::string read_string();
+  void read_tag(const char (&tag)[5]);
+
+  // Skip to the next PGSIZE boundary
+  void align();
+
+  // The next len bytes, in place.  The file is mapped privately, so they
+  // may be modified, and stay valid as long as mapping() is held.
+  char* map(size_t len);
+  std::shared_ptr<char> mapping() const { return base; }
+  size_t mapping_size() const { return size; }
+
+private:
+  std::string path;
+  std::shared_ptr<char> base;
+  size_t size;
+  size_t offset;
+
+  void check(size_t len);
+};
+
+#endif
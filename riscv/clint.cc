@@ -1,6 +1,8 @@
 #include <sys/time.h>
 #include "devices.h"
 #include "processor.h"
+#include "checkpoint.h"
+#include <stdexcept>
 
 clint_t::clint_t(std::vector<processor_t*>& procs, uint64_t freq_hz, bool real_time)
   : procs(procs), freq_hz(freq_hz), real_time(real_time), mtime(0), mtimecmp(procs.size())
@@ -88,3 +90,30 @@ void clint_t::increment(reg_t inc)
       procs[i]->state.mip->backdoor_write_with_mask(MIP_MTIP, MIP_MTIP);
   }
 }
+
+void clint_t::save(checkpoint_writer_t& out) const
+{
+  out.write_tag("CLNT");
+  out.write(mtime);
+  out.write(uint64_t(mtimecmp.size()));
+  out.write(mtimecmp.data(), mtimecmp.size() * sizeof(mtimecmp_t));
+}
+
+void clint_t::restore(checkpoint_reader_t& in)
+{
+  in.read_tag("CLNT");
+  mtime = in.read<mtime_t>();
+  if (in.read<uint64_t>() != mtimecmp.size())
+    throw std::runtime_error("checkpoint has a different number of harts");
+  in.read(mtimecmp.data(), mtimecmp.size() * sizeof(mtimecmp_t));
+
+  if (real_time) {
+    // carry on counting from the saved time
+    struct timeval now;
+    gettimeofday(&now, NULL);
+    uint64_t ref_usecs = now.tv_sec * 1000000 + now.tv_usec - mtime * 1000000 / freq_hz;
+    real_time_ref_secs = ref_usecs / 1000000;
+    real_time_ref_usecs = ref_usecs % 1000000;
+  }
+  increment(0);
+}
@@ -0,0 +1,156 @@
+// See LICENSE for license details.
+
+#include "commit_log.h"
+#include "processor.h"
+#include "log_writer.h"
+
+binary_commit_log_t::binary_commit_log_t(log_writer_t* out, bool text)
+  : out(out), text(text), last_hart(-1)
+{
+  if (!text)
+    out->write(stream_magic, sizeof(stream_magic));
+}
+
+void binary_commit_log_t::restart()
+{
+  harts.clear();
+  last_hart = -1;
+  if (!text)
+    out->write(stream_magic, sizeof(stream_magic));
+}
+
+void binary_commit_log_t::put(uint64_t val)
+{
+  while (val >= 0x80) {
+    buf.push_back(uint8_t(val) | 0x80);
+    val >>= 7;
+  }
+  buf.push_back(uint8_t(val));
+}
+
+void binary_commit_log_t::log_insn(processor_t* p, reg_t pc, insn_t insn)
+{
+  state_t* state = p->get_state();
+  uint32_t id = p->get_id();
+  int xlen = state->last_inst_xlen;
+  int flen = state->last_inst_flen;
+
+  if (id >= harts.size())
+    harts.resize(id + 1);
+  hart_t& h = harts[id];
+
+  buf.clear();
+
+  if (!h.synced || h.since_sync >= SYNC_INTERVAL || h.xlen != xlen || h.flen != flen) {
+    buf.push_back(SYNC);
+    buf.insert(buf.end(), sync_magic, sync_magic + sizeof(sync_magic));
+    put(id);
+    put(xlen);
+    put(flen);
+    put(p->VU.VLEN);
+    put(pc);
+    h = hart_t();
+    h.synced = true;
+    h.xlen = xlen;
+    h.flen = flen;
+    h.next_pc = pc;
+    last_hart = id;
+  }
+  h.since_sync++;
+
+  auto& regs = state->log_reg_write;
+  auto& loads = state->log_mem_read;
+  auto& stores = state->log_mem_write;
+
+  size_t nregs = 0;
+  for (auto item : regs)
+    nregs += item.first != 0;
+
+  uint8_t flags = state->last_inst_priv & 3;
+  if (id != last_hart)
+    flags |= F_HART;
+  if (pc == h.next_pc)
+    flags |= F_SEQ;
+  if (nregs)
+    flags |= F_REGS;
+  if (!loads.empty())
+    flags |= F_LOADS;
+  if (!stores.empty())
+    flags |= F_STORES;
+
+  buf.push_back(flags);
+  if (flags & F_HART)
+    put(id);
+  if (!(flags & F_SEQ))
+    put_signed(pc - h.next_pc);
+  put(insn.bits());
+
+  if (flags & F_REGS) {
+    bool vconfig = false;
+    put(nregs);
+    for (auto item : regs) {
+      if (item.first == 0)
+        continue;
+
+      reg_t rd = item.first >> 4;
+      put(item.first);
+      int type = item.first & 0xf;
+      if (!vconfig && (type == 2 || type == 3)) {
+        put(p->VU.vsew);
+        bool frac = p->VU.vflmul < 1;
+        put(frac ? (reg_t)(1 / p->VU.vflmul) : (reg_t)p->VU.vflmul);
+        buf.push_back(frac);
+        put(p->VU.vl->read());
+        vconfig = true;
+      }
+
+      switch (type) {
+      case 0:
+        put_signed(item.second.v[0] - h.xpr[rd]);
+        h.xpr[rd] = item.second.v[0];
+        break;
+      case 1:
+        put(flen < 64 ? item.second.v[0] & ((UINT64_C(1) << flen) - 1) : item.second.v[0]);
+        if (flen > 64)
+          put(item.second.v[1]);
+        break;
+      case 2: {
+        const uint8_t* data = &p->VU.elt<uint8_t>(rd, 0);
+        buf.insert(buf.end(), data, data + p->VU.VLEN / 8);
+        break;
+      }
+      case 3:
+        break;
+      default:
+        put(item.second.v[0]);
+        break;
+      }
+    }
+  }
+
+  if (flags & F_LOADS) {
+    put(loads.size());
+    for (auto item : loads) {
+      put_signed(std::get<0>(item) - h.addr);
+      h.addr = std::get<0>(item);
+    }
+  }
+
+  if (flags & F_STORES) {
+    put(stores.size());
+    for (auto item : stores) {
+      put_signed(std::get<0>(item) - h.addr);
+      h.addr = std::get<0>(item);
+      put(std::get<2>(item));
+      put(std::get<1>(item));
+    }
+  }
+
+  h.next_pc = pc + insn.length();
+  last_hart = id;
+
+  if (text)
+    out->commit(buf.data(), buf.size());
+  else
+    out->write(buf.data(), buf.size());
+}
@@ -0,0 +1,159 @@
+// See LICENSE for license details.
+#ifndef _RISCV_COMMIT_LOG_H
+#define _RISCV_COMMIT_LOG_H
+
+#include "decode.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <vector>
+
+class processor_t;
+class log_writer_t;
+
+// Print a value of the given width in bits the way the commit log does
+void commit_log_print_value(FILE *log_file, int width, const void *data);
+void commit_log_print_value(FILE *log_file, int width, uint64_t val);
+
+// A compact binary form of the commit log (--log-commits-binary), which
+// spike-log-decode turns back into the text form.  A stream is
+//
+//   stream := "SPIKECL\1" record*
+//   record := sync | insn
+//   sync   := 0xff "SPKSYNC" hart xlen flen vlen pc
+//   insn   := flags [hart] [pc] bits [regs] [loads] [stores]
+//   regs   := count { key [vconfig] value }
+//   loads  := count { addr }
+//   stores := count { addr size value }
+//
+// All numbers are LEB128 varints; signed ones are zigzag-encoded.  Bits 1:0
+// of flags hold the privilege mode and the others are the F_* bits below;
+// bit 7 is never set, so 0xff always starts a sync record.  The PC is a delta
+// from the fall-through PC of the hart's previous instruction and is omitted
+// when they match.  Memory addresses and integer register values are deltas
+// from the hart's previous address and that register's previous value.
+// Every hart emits a sync record, which resets all the deltas, at least every
+// SYNC_INTERVAL instructions, so decoding can start at any sync record.
+//
+// Register keys are those of state_t::log_reg_write.  Integer and CSR values
+// are one varint, FP values one varint per 64 bits of FLEN, and vector
+// registers VLEN/8 raw bytes.  The first vector key of a record is followed
+// by the vector configuration: vsew, LMUL, whether LMUL is fractional (in
+// which case it is stored as 1/LMUL), and vl.
+// Constants of the format
+struct commit_log_format_t
+{
+  static constexpr char stream_magic[8] = {'S', 'P', 'I', 'K', 'E', 'C', 'L', 1};
+  static constexpr char sync_magic[7] = {'S', 'P', 'K', 'S', 'Y', 'N', 'C'};
+  static constexpr uint8_t SYNC = 0xff;
+  static constexpr size_t SYNC_INTERVAL = 1 << 16;
+
+  // flags bits above the privilege mode
+  enum {
+    F_HART = 1 << 2,   // hart differs from the previous record
+    F_SEQ = 1 << 3,    // PC is the fall-through PC; no delta follows
+    F_REGS = 1 << 4,
+    F_LOADS = 1 << 5,
+    F_STORES = 1 << 6,
+  };
+};
+
+class binary_commit_log_t : private commit_log_format_t
+{
+public:
+  // Write the stream to out, or if text is set, hand each record to out to
+  // be printed in the text format
+  binary_commit_log_t(log_writer_t* out, bool text);
+
+  // Append the record of the instruction that was just executed
+  void log_insn(processor_t* p, reg_t pc, insn_t insn);
+
+  // Start a new stream, for when out has been switched to another file
+  void restart();
+
+private:
+  struct hart_t {
+    bool synced = false;
+    size_t since_sync = 0;
+    int xlen = 0, flen = 0;
+    reg_t next_pc = 0;
+    reg_t addr = 0;
+    reg_t xpr[NXPR] = {};
+  };
+
+  log_writer_t* out;
+  bool text;
+  std::vector<hart_t> harts;
+  uint32_t last_hart;
+  std::vector<uint8_t> buf;
+
+  void put(uint64_t val);
+  void put_signed(int64_t val) { put((uint64_t(val) << 1) ^ uint64_t(val >> 63)); }
+};
+
+// Reads a binary commit log one instruction at a time
+class binary_commit_log_reader_t : private commit_log_format_t
+{
+public:
+  binary_commit_log_reader_t(FILE* file);
+
+  // A reader for records handed to it with feed(), without the stream magic
+  binary_commit_log_reader_t();
+
+  // Decode these bytes next.  Records must not be split between calls.
+  void feed(const uint8_t* data, size_t len);
+
+  // Continue from the first sync record at or after this byte offset
+  void seek(long offset);
+
+  // Decode the next instruction record; returns false at end of stream.
+  // Throws std::runtime_error if the stream is malformed.
+  bool next();
+
+  reg_t pc() const { return cur.pc; }
+
+  // Print the current instruction in the text commit-log format
+  void print(FILE* out) const;
+
+private:
+  struct reg_write_t {
+    reg_t key;
+    uint64_t val[2];
+    std::vector<uint8_t> vreg;
+  };
+  struct insn_rec_t {
+    uint32_t hart;
+    int priv, xlen, flen;
+    reg_t pc;
+    insn_bits_t bits;
+    std::vector<reg_write_t> regs;
+    bool has_vconfig;
+    reg_t vsew, lmul, vl;
+    bool lmul_frac;
+    std::vector<reg_t> loads;
+    std::vector<std::tuple<reg_t, uint64_t, uint8_t>> stores;
+  };
+  struct hart_t {
+    bool synced = false;
+    int xlen = 0, flen = 0;
+    reg_t vlen = 0;
+    reg_t next_pc = 0;
+    reg_t addr = 0;
+    reg_t xpr[NXPR] = {};
+  };
+
+  FILE* file;
+  const uint8_t* data;
+  const uint8_t* data_end;
+  std::vector<hart_t> harts;
+  uint32_t cur_hart;
+  insn_rec_t cur;
+
+  int get_byte(bool eof_ok = false);
+  void get_bytes(void* buf, size_t len);
+  uint64_t get();
+  int64_t get_signed() { uint64_t v = get(); return int64_t(v >> 1) ^ -int64_t(v & 1); }
+  hart_t& hart(uint32_t id);
+  void read_sync();
+};
+
+#endif
@@ -0,0 +1,297 @@
+// See LICENSE for license details.
+
+// The parts of the binary commit log shared with spike-log-decode, which
+// must not depend on the rest of the simulator.
+
+#include "commit_log.h"
+#include "disasm.h"
+#include <cassert>
+#include <cstring>
+#include <stdexcept>
+
+void commit_log_print_value(FILE *log_file, int width, const void *data)
+{
+  assert(log_file);
+
+  switch (width) {
+    case 8:
+      fprintf(log_file, "0x%01" PRIx8, *(const uint8_t *)data);
+      break;
+    case 16:
+      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
+      break;
+    case 32:
+      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
+      break;
+    case 64:
+      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
+      break;
+    default:
+      // max lengh of vector
+      if (((width - 1) & width) == 0) {
+        const uint64_t *arr = (const uint64_t *)data;
+
+        fprintf(log_file, "0x");
+        for (int idx = width / 64 - 1; idx >= 0; --idx) {
+          fprintf(log_file, "%016" PRIx64, arr[idx]);
+        }
+      } else {
+        abort();
+      }
+      break;
+  }
+}
+
+void commit_log_print_value(FILE *log_file, int width, uint64_t val)
+{
+  commit_log_print_value(log_file, width, &val);
+}
+
+binary_commit_log_reader_t::binary_commit_log_reader_t(FILE* file)
+  : file(file), data(NULL), data_end(NULL), cur_hart(0)
+{
+  char magic[sizeof(stream_magic)];
+  if (fread(magic, 1, sizeof(magic), file) != sizeof(magic) ||
+      memcmp(magic, stream_magic, sizeof(magic)) != 0)
+    throw std::runtime_error("not a binary commit log");
+}
+
+binary_commit_log_reader_t::binary_commit_log_reader_t()
+  : file(NULL), data(NULL), data_end(NULL), cur_hart(0)
+{
+}
+
+void binary_commit_log_reader_t::feed(const uint8_t* data, size_t len)
+{
+  this->data = data;
+  data_end = data + len;
+}
+
+void binary_commit_log_reader_t::seek(long offset)
+{
+  if (fseek(file, offset, SEEK_SET) != 0)
+    throw std::runtime_error("can't seek in commit log");
+
+  harts.clear();
+
+  // a sync record is the only place 0xff can start a record, but it can also
+  // appear inside one, so match the whole marker
+  size_t matched = 0;
+  int c;
+  while ((c = getc(file)) != EOF) {
+    if (matched == 0) {
+      matched = c == SYNC;
+    } else if (c == (uint8_t)sync_magic[matched - 1]) {
+      if (++matched == sizeof(sync_magic) + 1) {
+        read_sync();
+        return;
+      }
+    } else {
+      matched = c == SYNC;
+    }
+  }
+}
+
+int binary_commit_log_reader_t::get_byte(bool eof_ok)
+{
+  int c = file ? getc(file) : data < data_end ? *data++ : EOF;
+  if (c == EOF && !eof_ok)
+    throw std::runtime_error("truncated commit log");
+  return c;
+}
+
+void binary_commit_log_reader_t::get_bytes(void* buf, size_t len)
+{
+  if (file) {
+    if (fread(buf, 1, len, file) != len)
+      throw std::runtime_error("truncated commit log");
+  } else {
+    if (size_t(data_end - data) < len)
+      throw std::runtime_error("truncated commit log");
+    memcpy(buf, data, len);
+    data += len;
+  }
+}
+
+uint64_t binary_commit_log_reader_t::get()
+{
+  uint64_t val = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    int c = get_byte();
+    val |= uint64_t(c & 0x7f) << shift;
+    if (!(c & 0x80))
+      return val;
+  }
+  throw std::runtime_error("bad varint in commit log");
+}
+
+binary_commit_log_reader_t::hart_t& binary_commit_log_reader_t::hart(uint32_t id)
+{
+  if (id >= harts.size())
+    harts.resize(id + 1);
+  return harts[id];
+}
+
+void binary_commit_log_reader_t::read_sync()
+{
+  uint32_t id = get();
+  hart_t& h = hart(id);
+  h = hart_t();
+  h.synced = true;
+  h.xlen = get();
+  h.flen = get();
+  h.vlen = get();
+  h.next_pc = get();
+  cur_hart = id;
+}
+
+bool binary_commit_log_reader_t::next()
+{
+  int flags;
+  while ((flags = get_byte(true)) == SYNC) {
+    char magic[sizeof(sync_magic)];
+    get_bytes(magic, sizeof(magic));
+    if (memcmp(magic, sync_magic, sizeof(magic)) != 0)
+      throw std::runtime_error("bad sync record in commit log");
+    read_sync();
+  }
+  if (flags == EOF)
+    return false;
+
+  if (flags & F_HART)
+    cur_hart = get();
+  hart_t& h = hart(cur_hart);
+  if (!h.synced)
+    throw std::runtime_error("commit log record before sync");
+
+  cur.hart = cur_hart;
+  cur.priv = flags & 3;
+  cur.xlen = h.xlen;
+  cur.flen = h.flen;
+  cur.pc = h.next_pc;
+  if (!(flags & F_SEQ))
+    cur.pc += get_signed();
+  cur.bits = get();
+
+  cur.regs.clear();
+  cur.has_vconfig = false;
+  if (flags & F_REGS) {
+    for (uint64_t n = get(); n > 0; n--) {
+      reg_write_t r;
+      r.key = get();
+      reg_t rd = r.key >> 4;
+      int type = r.key & 0xf;
+      if (!cur.has_vconfig && (type == 2 || type == 3)) {
+        cur.vsew = get();
+        cur.lmul = get();
+        cur.lmul_frac = get_byte();
+        cur.vl = get();
+        cur.has_vconfig = true;
+      }
+
+      r.val[0] = r.val[1] = 0;
+      switch (type) {
+      case 0:
+        if (rd >= NXPR)
+          throw std::runtime_error("bad register in commit log");
+        h.xpr[rd] += get_signed();
+        r.val[0] = h.xpr[rd];
+        break;
+      case 1:
+        r.val[0] = get();
+        if (h.flen > 64)
+          r.val[1] = get();
+        break;
+      case 2:
+        r.vreg.resize(h.vlen / 8);
+        get_bytes(r.vreg.data(), r.vreg.size());
+        break;
+      case 3:
+        break;
+      case 4:
+        r.val[0] = get();
+        break;
+      default:
+        throw std::runtime_error("bad register in commit log");
+      }
+      cur.regs.push_back(std::move(r));
+    }
+  }
+
+  cur.loads.clear();
+  if (flags & F_LOADS) {
+    for (uint64_t n = get(); n > 0; n--) {
+      h.addr += get_signed();
+      cur.loads.push_back(h.addr);
+    }
+  }
+
+  cur.stores.clear();
+  if (flags & F_STORES) {
+    for (uint64_t n = get(); n > 0; n--) {
+      h.addr += get_signed();
+      uint8_t size = get();
+      uint64_t val = get();
+      cur.stores.push_back(std::make_tuple(h.addr, val, size));
+    }
+  }
+
+  h.next_pc = cur.pc + insn_length(cur.bits);
+  return true;
+}
+
+void binary_commit_log_reader_t::print(FILE* out) const
+{
+  fprintf(out, "core%4" PRId32 ": ", cur.hart);
+
+  fprintf(out, "%1d ", cur.priv);
+  commit_log_print_value(out, cur.xlen, cur.pc);
+  fprintf(out, " (");
+  commit_log_print_value(out, insn_length(cur.bits) * 8, cur.bits);
+  fprintf(out, ")");
+  bool show_vec = false;
+
+  for (auto& r : cur.regs) {
+    int rd = r.key >> 4;
+    int type = r.key & 0xf;
+    bool is_vec = type == 2 || type == 3;
+
+    if (!show_vec && is_vec) {
+      fprintf(out, " e%ld %s%ld l%ld",
+              (long)cur.vsew, cur.lmul_frac ? "mf" : "m", (long)cur.lmul, (long)cur.vl);
+      show_vec = true;
+    }
+
+    switch (type) {
+    case 0:
+      fprintf(out, " x%-2d ", rd);
+      commit_log_print_value(out, cur.xlen, r.val);
+      break;
+    case 1:
+      fprintf(out, " f%-2d ", rd);
+      commit_log_print_value(out, cur.flen, r.val);
+      break;
+    case 2:
+      fprintf(out, " v%-2d ", rd);
+      commit_log_print_value(out, r.vreg.size() * 8, r.vreg.data());
+      break;
+    case 4:
+      fprintf(out, " c%d_%s ", rd, csr_name(rd));
+      commit_log_print_value(out, cur.xlen, r.val);
+      break;
+    }
+  }
+
+  for (auto addr : cur.loads) {
+    fprintf(out, " mem ");
+    commit_log_print_value(out, cur.xlen, addr);
+  }
+
+  for (auto& item : cur.stores) {
+    fprintf(out, " mem ");
+    commit_log_print_value(out, cur.xlen, std::get<0>(item));
+    fprintf(out, " ");
+    commit_log_print_value(out, std::get<2>(item) << 3, std::get<1>(item));
+  }
+  fprintf(out, "\n");
+}
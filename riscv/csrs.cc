@@ -61,9 +61,8 @@ void csr_t::log_write() const noexcept {
 }
 
 void csr_t::log_special_write(const reg_t address, const reg_t val) const noexcept {
-#if defined(RISCV_ENABLE_COMMITLOG)
-  proc->get_state()->log_reg_write[((address) << 4) | 4] = {val, 0};
-#endif
+  if (proc->get_log_commits_enabled())
+    proc->get_state()->log_reg_write[((address) << 4) | 4] = {val, 0};
 }
 
 reg_t csr_t::written_value() const noexcept {
@@ -642,6 +641,10 @@ bool misa_csr_t::unlogged_write(const reg_t val) noexcept {
     state->hstatus->write(0);
   }
 
+  // translated blocks are specialized on the enabled extensions
+  if (new_misa != old_misa)
+    proc->get_mmu()->flush_icache();
+
   return basic_csr_t::unlogged_write(new_misa);
 }
 
@@ -1183,6 +1186,15 @@ bool dcsr_csr_t::unlogged_write(const reg_t val) noexcept {
   return true;
 }
 
+reg_t dcsr_csr_t::save() const noexcept {
+  return set_field(read(), DCSR_HALT, halt);
+}
+
+void dcsr_csr_t::restore(const reg_t val) noexcept {
+  unlogged_write(val);
+  cause = get_field(val, DCSR_CAUSE);
+}
+
 void dcsr_csr_t::write_cause_and_prv(uint8_t cause, reg_t prv) noexcept {
   this->cause = cause;
   this->prv = prv;
@@ -30,6 +30,13 @@ class csr_t {
   // Child classes must implement unlogged_write()
   void write(const reg_t val) noexcept;
 
+  // For checkpoints: save() returns the state of this CSR, and restore()
+  // puts it back without logging.  A CSR that is only a view of state held
+  // elsewhere (an alias, or half of a wider CSR) has none of its own.
+  virtual bool has_state() const noexcept { return true; }
+  virtual reg_t save() const noexcept { return read(); }
+  virtual void restore(const reg_t val) noexcept { unlogged_write(val); }
+
   virtual ~csr_t();
 
  protected:
@@ -155,6 +162,7 @@ class virtualized_csr_t: public csr_t {
   virtualized_csr_t(processor_t* const proc, csr_t_p orig, csr_t_p virt);
 
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
   // Instead of using state.v, explicitly request original or virtual:
   reg_t readvirt(bool virt) const noexcept;
  protected:
@@ -259,6 +267,7 @@ class rv32_low_csr_t: public csr_t {
  public:
   rv32_low_csr_t(processor_t* const proc, const reg_t addr, csr_t_p orig);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
   virtual void verify_permissions(insn_t insn, bool write) const override;
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
@@ -271,6 +280,7 @@ class rv32_high_csr_t: public csr_t {
  public:
   rv32_high_csr_t(processor_t* const proc, const reg_t addr, csr_t_p orig);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
   virtual void verify_permissions(insn_t insn, bool write) const override;
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
@@ -286,6 +296,7 @@ class sstatus_proxy_csr_t final: public base_status_csr_t {
   reg_t read() const noexcept override {
     return mstatus->read() & sstatus_read_mask;
   }
+  virtual bool has_state() const noexcept override { return false; }
 
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
@@ -334,6 +345,7 @@ class mip_or_mie_csr_t: public csr_t {
  public:
   mip_or_mie_csr_t(processor_t* const proc, const reg_t addr);
   virtual reg_t read() const noexcept override final;
+  virtual void restore(const reg_t val) noexcept override { this->val = val; }
 
   void write_with_mask(const reg_t mask, const reg_t val) noexcept;
 
@@ -402,6 +414,7 @@ class mip_proxy_csr_t: public csr_t {
  public:
   mip_proxy_csr_t(processor_t* const proc, const reg_t addr, generic_int_accessor_t_p accr);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -413,6 +426,7 @@ class mie_proxy_csr_t: public csr_t {
  public:
   mie_proxy_csr_t(processor_t* const proc, const reg_t addr, generic_int_accessor_t_p accr);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -501,6 +515,7 @@ class wide_counter_csr_t: public csr_t {
   wide_counter_csr_t(processor_t* const proc, const reg_t addr);
   // Always returns full 64-bit value
   virtual reg_t read() const noexcept override;
+  virtual void restore(const reg_t val) noexcept override { this->val = val; }
   void bump(const reg_t howmuch) noexcept;
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
@@ -515,6 +530,8 @@ class time_counter_csr_t: public csr_t {
  public:
   time_counter_csr_t(processor_t* const proc, const reg_t addr);
   virtual reg_t read() const noexcept override;
+  virtual reg_t save() const noexcept override { return shadow_val; }
+  virtual void restore(const reg_t val) noexcept override { shadow_val = val; }
 
   void sync(const reg_t val) noexcept;
 
@@ -531,6 +548,7 @@ class proxy_csr_t: public csr_t {
  public:
   proxy_csr_t(processor_t* const proc, const reg_t addr, csr_t_p delegate);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -542,6 +560,7 @@ class const_csr_t: public csr_t {
  public:
   const_csr_t(processor_t* const proc, const reg_t addr, reg_t val);
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -591,6 +610,8 @@ class tdata1_csr_t: public csr_t {
  public:
   tdata1_csr_t(processor_t* const proc, const reg_t addr);
   virtual reg_t read() const noexcept override;
+  // a view of the trigger selected by tselect
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
 };
@@ -599,6 +620,8 @@ class tdata2_csr_t: public csr_t {
  public:
   tdata2_csr_t(processor_t* const proc, const reg_t addr);
   virtual reg_t read() const noexcept override;
+  // a view of the trigger selected by tselect
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
 };
@@ -623,6 +646,8 @@ class dcsr_csr_t: public csr_t {
   dcsr_csr_t(processor_t* const proc, const reg_t addr);
   virtual void verify_permissions(insn_t insn, bool write) const override;
   virtual reg_t read() const noexcept override;
+  virtual reg_t save() const noexcept override;
+  virtual void restore(const reg_t val) noexcept override;
   void write_cause_and_prv(uint8_t cause, reg_t prv) noexcept;
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
@@ -643,6 +668,8 @@ class float_csr_t final: public masked_csr_t {
  public:
   float_csr_t(processor_t* const proc, const reg_t addr, const reg_t mask, const reg_t init);
   virtual void verify_permissions(insn_t insn, bool write) const override;
+  // without touching mstatus.FS, which may be Off
+  virtual void restore(const reg_t val) noexcept override { masked_csr_t::unlogged_write(val); }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
 };
@@ -657,6 +684,7 @@ class composite_csr_t: public csr_t {
   composite_csr_t(processor_t* const proc, const reg_t addr, csr_t_p upper_csr, csr_t_p lower_csr, const unsigned upper_lsb);
   virtual void verify_permissions(insn_t insn, bool write) const override;
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -670,6 +698,7 @@ class seed_csr_t: public csr_t {
   seed_csr_t(processor_t* const proc, const reg_t addr);
   virtual void verify_permissions(insn_t insn, bool write) const override;
   virtual reg_t read() const noexcept override;
+  virtual bool has_state() const noexcept override { return false; }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
 };
@@ -680,6 +709,7 @@ class vector_csr_t: public basic_csr_t {
   virtual void verify_permissions(insn_t insn, bool write) const override;
   // Write without regard to mask, and without touching mstatus.VS
   void write_raw(const reg_t val) noexcept;
+  virtual void restore(const reg_t val) noexcept override { basic_csr_t::unlogged_write(val); }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
  private:
@@ -693,6 +723,8 @@ class vxsat_csr_t: public masked_csr_t {
  public:
   vxsat_csr_t(processor_t* const proc, const reg_t addr);
   virtual void verify_permissions(insn_t insn, bool write) const override;
+  // without touching mstatus.VS, which may be Off
+  virtual void restore(const reg_t val) noexcept override { masked_csr_t::unlogged_write(val); }
  protected:
   virtual bool unlogged_write(const reg_t val) noexcept override;
 };
@@ -5,6 +5,7 @@
 #include "debug_defines.h"
 #include "opcodes.h"
 #include "mmu.h"
+#include "checkpoint.h"
 
 #include "debug_rom/debug_rom.h"
 #include "debug_rom_defines.h"
@@ -938,3 +939,53 @@ void debug_module_t::proc_reset(unsigned id)
   hart_state[id].halted = false;
   hart_state[id].haltgroup = 0;
 }
+
+void debug_module_t::save(checkpoint_writer_t& out) const
+{
+  out.write_tag("DM  ");
+  out.write(debug_rom_whereto);
+  out.write(debug_abstract);
+  out.write(program_buffer, program_buffer_bytes);
+  out.write(dmdata);
+  out.write(hart_state.data(), hart_state.size() * sizeof(hart_debug_state_t));
+  out.write(debug_rom_flags);
+  out.write(dmcontrol);
+  out.write(dmstatus);
+  out.write(abstractcs);
+  out.write(abstractauto);
+  out.write(command);
+  out.write(hawindowsel);
+  for (size_t i = 0; i < hart_array_mask.size(); i++)
+    out.write(bool(hart_array_mask[i]));
+  out.write(sbcs);
+  out.write(sbaddress);
+  out.write(sbdata);
+  out.write(challenge);
+  out.write(abstract_command_completed);
+  out.write(rti_remaining);
+}
+
+void debug_module_t::restore(checkpoint_reader_t& in)
+{
+  in.read_tag("DM  ");
+  in.read(debug_rom_whereto, sizeof(debug_rom_whereto));
+  in.read(debug_abstract, sizeof(debug_abstract));
+  in.read(program_buffer, program_buffer_bytes);
+  in.read(dmdata, sizeof(dmdata));
+  in.read(hart_state.data(), hart_state.size() * sizeof(hart_debug_state_t));
+  in.read(debug_rom_flags, sizeof(debug_rom_flags));
+  dmcontrol = in.read<dmcontrol_t>();
+  dmstatus = in.read<dmstatus_t>();
+  abstractcs = in.read<abstractcs_t>();
+  abstractauto = in.read<abstractauto_t>();
+  command = in.read<uint32_t>();
+  hawindowsel = in.read<uint16_t>();
+  for (size_t i = 0; i < hart_array_mask.size(); i++)
+    hart_array_mask[i] = in.read<bool>();
+  sbcs = in.read<sbcs_t>();
+  in.read(sbaddress, sizeof(sbaddress));
+  in.read(sbdata, sizeof(sbdata));
+  challenge = in.read<uint32_t>();
+  abstract_command_completed = in.read<bool>();
+  rti_remaining = in.read<unsigned>();
+}
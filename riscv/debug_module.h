@@ -9,6 +9,8 @@
 
 class sim_t;
 class bus_t;
+class checkpoint_writer_t;
+class checkpoint_reader_t;
 
 typedef struct {
     // Size of program_buffer in 32-bit words, as exposed to the rest of the
@@ -128,6 +130,9 @@ class debug_module_t : public abstract_device_t
     // Called when one of the attached harts was reset.
     void proc_reset(unsigned id);
 
+    void save(checkpoint_writer_t& out) const;
+    void restore(checkpoint_reader_t& in);
+
   private:
     static const unsigned datasize = 2;
     unsigned nprocs;
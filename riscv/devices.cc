@@ -1,5 +1,6 @@
 #include "devices.h"
 #include "mmu.h"
+#include "checkpoint.h"
 #include <stdexcept>
 
 void bus_t::add_device(reg_t addr, abstract_device_t* dev)
@@ -92,7 +93,7 @@ bool mmio_plugin_device_t::store(reg_t addr, size_t len, const uint8_t* bytes)
 }
 
 mem_t::mem_t(reg_t size)
-  : sz(size)
+  : sz(size), checkpoint_size(0)
 {
   if (size == 0 || size % PGSIZE != 0)
     throw std::runtime_error("memory size must be a positive multiple of 4 KiB");
@@ -100,8 +101,17 @@ mem_t::mem_t(reg_t size)
 
 mem_t::~mem_t()
 {
-  for (auto& entry : sparse_memory_map)
-    free(entry.second);
+  free_pages();
+}
+
+void mem_t::free_pages()
+{
+  char* base = checkpoint.get();
+  for (auto& entry : sparse_memory_map) {
+    if (entry.second < base || entry.second >= base + checkpoint_size)
+      free(entry.second);
+  }
+  sparse_memory_map.clear();
 }
 
 bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
@@ -127,6 +137,7 @@ bool mem_t::load_store(reg_t addr, size_t len, uint8_t* bytes, bool store)
 
 char* mem_t::contents(reg_t addr) {
   reg_t ppn = addr >> PGSHIFT, pgoff = addr % PGSIZE;
+  std::lock_guard<std::mutex> guard(sparse_memory_lock);
   auto search = sparse_memory_map.find(ppn);
   if (search == sparse_memory_map.end()) {
     auto res = (char*)calloc(PGSIZE, 1);
@@ -137,3 +148,40 @@ char* mem_t::contents(reg_t addr) {
   }
   return search->second + pgoff;
 }
+
+void mem_t::save(checkpoint_writer_t& out) const
+{
+  // Pages that were only read are still zero, and needn't be saved
+  static const char zeros[PGSIZE] = {};
+  std::vector<std::pair<reg_t, const char*>> pages;
+  for (auto& entry : sparse_memory_map) {
+    if (memcmp(entry.second, zeros, PGSIZE) != 0)
+      pages.push_back(entry);
+  }
+
+  out.write_tag("MEM ");
+  out.write(sz);
+  out.write(uint64_t(pages.size()));
+  for (auto& page : pages)
+    out.write(page.first);
+  out.align();
+  for (auto& page : pages)
+    out.write(page.second, PGSIZE);
+}
+
+void mem_t::restore(checkpoint_reader_t& in)
+{
+  in.read_tag("MEM ");
+  if (in.read<reg_t>() != sz)
+    throw std::runtime_error("checkpoint has a different memory size");
+  std::vector<reg_t> ppns(in.read<uint64_t>());
+  for (auto& ppn : ppns)
+    ppn = in.read<reg_t>();
+  in.align();
+
+  free_pages();
+  checkpoint = in.mapping();
+  checkpoint_size = in.mapping_size();
+  for (auto ppn : ppns)
+    sparse_memory_map[ppn] = in.map(PGSIZE);
+}
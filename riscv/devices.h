@@ -6,10 +6,14 @@
 #include "abstract_device.h"
 #include "platform.h"
 #include <map>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <utility>
 
 class processor_t;
+class checkpoint_writer_t;
+class checkpoint_reader_t;
 
 class bus_t : public abstract_device_t {
  public:
@@ -44,11 +48,21 @@ class mem_t : public abstract_device_t {
   char* contents(reg_t addr);
   reg_t size() { return sz; }
 
+  // Write the pages touched so far to a checkpoint, or replace the contents
+  // with those of a checkpoint.  Restored pages are left in the checkpoint's
+  // copy-on-write mapping, so only those that are used get read.
+  void save(checkpoint_writer_t& out) const;
+  void restore(checkpoint_reader_t& in);
+
  private:
   bool load_store(reg_t addr, size_t len, uint8_t* bytes, bool store);
+  void free_pages();
 
   std::map<reg_t, char*> sparse_memory_map;
+  std::mutex sparse_memory_lock; // harts on several threads allocate pages
   reg_t sz;
+  std::shared_ptr<char> checkpoint; // holds restored pages
+  size_t checkpoint_size;
 };
 
 class clint_t : public abstract_device_t {
@@ -58,6 +72,8 @@ class clint_t : public abstract_device_t {
   bool store(reg_t addr, size_t len, const uint8_t* bytes);
   size_t size() { return CLINT_SIZE; }
   void increment(reg_t inc);
+  void save(checkpoint_writer_t& out) const;
+  void restore(checkpoint_reader_t& in);
  private:
   typedef uint64_t mtime_t;
   typedef uint64_t mtimecmp_t;
@@ -89,9 +89,25 @@ public:
   // The file to read entropy from.
   std::string randomness_source = "/dev/urandom";
 
+  // Or, for reproducible runs, a generator (splitmix64) and its state.
+  bool prng_seeded = false;
+  uint64_t prng_state = 0;
+
+  void set_prng_seed(uint64_t seed) {
+    prng_seeded = true;
+    prng_state = seed;
+  }
+
   // Read two random bytes from the entropy source file.
   uint16_t get_two_random_bytes() {
 
+      if (prng_seeded) {
+          uint64_t z = (prng_state += 0x9e3779b97f4a7c15);
+          z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9;
+          z = (z ^ (z >> 27)) * 0x94d049bb133111eb;
+          return (uint16_t)(z ^ (z >> 31));
+      }
+
       std::ifstream fh(this -> randomness_source, std::ios::binary);
 
       if(fh.is_open()) {
@@ -3,9 +3,10 @@
 #include "processor.h"
 #include "mmu.h"
 #include "disasm.h"
+#include "commit_log.h"
+#include "bbv.h"
 #include <cassert>
 
-#ifdef RISCV_ENABLE_COMMITLOG
 static void commit_log_reset(processor_t* p)
 {
   p->get_state()->log_reg_write.clear();
@@ -21,44 +22,6 @@ static void commit_log_stash_privilege(processor_t* p)
   state->last_inst_flen = p->get_flen();
 }
 
-static void commit_log_print_value(FILE *log_file, int width, const void *data)
-{
-  assert(log_file);
-
-  switch (width) {
-    case 8:
-      fprintf(log_file, "0x%01" PRIx8, *(const uint8_t *)data);
-      break;
-    case 16:
-      fprintf(log_file, "0x%04" PRIx16, *(const uint16_t *)data);
-      break;
-    case 32:
-      fprintf(log_file, "0x%08" PRIx32, *(const uint32_t *)data);
-      break;
-    case 64:
-      fprintf(log_file, "0x%016" PRIx64, *(const uint64_t *)data);
-      break;
-    default:
-      // max lengh of vector
-      if (((width - 1) & width) == 0) {
-        const uint64_t *arr = (const uint64_t *)data;
-
-        fprintf(log_file, "0x");
-        for (int idx = width / 64 - 1; idx >= 0; --idx) {
-          fprintf(log_file, "%016" PRIx64, arr[idx]);
-        }
-      } else {
-        abort();
-      }
-      break;
-  }
-}
-
-static void commit_log_print_value(FILE *log_file, int width, uint64_t val)
-{
-  commit_log_print_value(log_file, width, &val);
-}
-
 const char* processor_t::get_symbol(uint64_t addr)
 {
   return sim->get_symbol(addr);
@@ -66,6 +29,11 @@ const char* processor_t::get_symbol(uint64_t addr)
 
 static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
 {
+  if (p->get_binary_commit_log()) {
+    p->get_binary_commit_log()->log_insn(p, pc, insn);
+    return;
+  }
+
   FILE *log_file = p->get_log_file();
 
   auto& reg = p->get_state()->log_reg_write;
@@ -154,11 +122,6 @@ static void commit_log_print_insn(processor_t *p, reg_t pc, insn_t insn)
   }
   fprintf(log_file, "\n");
 }
-#else
-static void commit_log_reset(processor_t* p) {}
-static void commit_log_stash_privilege(processor_t* p) {}
-static void commit_log_print_insn(processor_t* p, reg_t pc, insn_t insn) {}
-#endif
 
 inline void processor_t::update_histogram(reg_t pc)
 {
@@ -167,27 +130,62 @@ inline void processor_t::update_histogram(reg_t pc)
 #endif
 }
 
-// This is expected to be inlined by the compiler so each use of execute_insn
-// includes a duplicated body of the function to get separate fetch.func
-// function calls.
-static inline reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
+// The fast path is entering block at pc.  A basic block ends with a control
+// transfer, so a block that follows on from one that didn't end with one,
+// or from where the last step stopped, continues the same basic block.
+void processor_t::bbv_enter_block(iblock_t* block, reg_t pc, size_t instret)
+{
+  bool continues = pc == bbv_resume_pc;
+  auto& last = block->insns[block->len - 1];
+  bbv_resume_pc = mmu->ends_iblock(last.fetch.insn.bits()) ? reg_t(-1) : last.npc;
+  if (continues)
+    return;
+
+  if (bbv_block != bbv_profile_t::NO_BLOCK)
+    bbv->count(bbv_block, instret - bbv_block_entered);
+  if (block->bbv_block == bbv_profile_t::NO_BLOCK)
+    block->bbv_block = bbv->lookup(pc);
+  bbv_block = block->bbv_block;
+  bbv_block_entered = instret;
+}
+
+void processor_t::bbv_end_step(size_t instret)
 {
-  commit_log_reset(p);
-  commit_log_stash_privilege(p);
+  if (bbv_block != bbv_profile_t::NO_BLOCK)
+    bbv->count(bbv_block, instret - bbv_block_entered);
+  bbv_block_entered = 0;
+
+  bbv_retired += instret;
+  if (bbv_retired >= bbv->get_interval()) {
+    bbv->end_interval();
+    bbv_retired = 0;
+  }
+}
+
+// These are expected to be inlined by the compiler so each use of
+// execute_insn_* includes a duplicated body of the function to get separate
+// fetch.func function calls.
+static inline reg_t execute_insn_fast(processor_t* p, reg_t pc, insn_fetch_t fetch)
+{
+  return fetch.func(p, fetch.insn, pc);
+}
+
+static inline reg_t execute_insn_logged(processor_t* p, reg_t pc, insn_fetch_t fetch)
+{
+  if (p->get_log_commits_enabled()) {
+    commit_log_reset(p);
+    commit_log_stash_privilege(p);
+  }
+
   reg_t npc;
 
   try {
     npc = fetch.func(p, fetch.insn, pc);
     if (npc != PC_SERIALIZE_BEFORE) {
-
-#ifdef RISCV_ENABLE_COMMITLOG
       if (p->get_log_commits_enabled()) {
         commit_log_print_insn(p, pc, fetch.insn);
       }
-#endif
-
      }
-#ifdef RISCV_ENABLE_COMMITLOG
   } catch (wait_for_interrupt_t &t) {
       if (p->get_log_commits_enabled()) {
         commit_log_print_insn(p, pc, fetch.insn);
@@ -204,7 +202,6 @@ static inline reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
         }
       }
       throw;
-#endif
   } catch(...) {
     throw;
   }
@@ -215,7 +212,8 @@ static inline reg_t execute_insn(processor_t* p, reg_t pc, insn_fetch_t fetch)
 
 bool processor_t::slow_path()
 {
-  return debug || state.single_step != state.STEP_NONE || state.debug_mode;
+  return debug || state.single_step != state.STEP_NONE || state.debug_mode ||
+         log_commits_enabled || histogram_enabled;
 }
 
 // fetch/decode/execute loop
@@ -232,10 +230,16 @@ void processor_t::step(size_t n)
     }
   }
 
+  if (unlikely(log_window_armed))
+    n = clip_to_log_window(n);
+  if (unlikely(bbv != NULL))
+    n = std::min<reg_t>(n, bbv->get_interval() - bbv_retired);
+
   while (n > 0) {
     size_t instret = 0;
     reg_t pc = state.pc;
     mmu_t* _mmu = mmu;
+    bool traced = false;
 
     #define advance_pc() \
      if (unlikely(invalid_pc(pc))) { \
@@ -260,6 +264,9 @@ void processor_t::step(size_t n)
         // Main simulation loop, slow path.
         while (instret < n)
         {
+          if (unlikely(log_window_armed) && update_log_window(pc, instret))
+            break;
+
           if (unlikely(!state.serialized && state.single_step == state.STEP_STEPPED)) {
             state.single_step = state.STEP_NONE;
             if (!state.debug_mode) {
@@ -274,27 +281,48 @@ void processor_t::step(size_t n)
           }
 
           insn_fetch_t fetch = mmu->load_insn(pc);
-          if (debug && !state.serialized)
+          traced = debug && !state.serialized;
+          if (traced && !stall_traced)
             disasm(fetch.insn);
-          pc = execute_insn(this, pc, fetch);
+          stall_traced = false;
+          pc = execute_insn_logged(this, pc, fetch);
+          traced = false;
           advance_pc();
         }
       }
       else while (instret < n)
       {
         // Main simulation loop, fast path.
-        for (auto ic_entry = _mmu->access_icache(pc); ; ) {
-          auto fetch = ic_entry->data;
-          pc = execute_insn(this, pc, fetch);
-          ic_entry = ic_entry->next;
-          if (unlikely(ic_entry->tag != pc))
+        if (unlikely(log_window_armed) && update_log_window(pc, instret))
+          break;
+
+        auto block = _mmu->access_iblock(pc);
+        if (unlikely(bbv != NULL))
+          bbv_enter_block(block, pc, instret);
+        if (block->jit_code && block->len <= n - instret && !bbv) {
+          if (size_t retired = block->jit_code()) {
+            instret += retired;
+            pc = state.pc;
+            continue;
+          }
+        }
+
+        reg_t block_pc = pc;
+        for (auto op = &block->insns[0], end = op + block->len; ; ) {
+          pc = execute_insn_fast(this, pc, op->fetch);
+          if (unlikely(pc != op->npc || ++op == end))
             break;
-          if (unlikely(instret + 1 == n))
+          if (unlikely(instret + 1 == n)) {
+            bbv_resume_pc = pc;
             break;
+          }
           instret++;
           state.pc = pc;
         }
 
+        if (unlikely(jit != NULL) && ++block->execs == jit_t::HOT_THRESHOLD)
+          block->jit_code = jit->compile(block, block_pc);
+
         advance_pc();
       }
     }
@@ -317,7 +345,7 @@ void processor_t::step(size_t n)
         // instructions are idempotent so restarting is safe.)
 
         insn_fetch_t fetch = mmu->load_insn(pc);
-        pc = execute_insn(this, pc, fetch);
+        pc = execute_insn_logged(this, pc, fetch);
         advance_pc();
 
         delete mmu->matched_trigger;
@@ -340,6 +368,14 @@ void processor_t::step(size_t n)
     {
       enter_debug_mode(DCSR_CAUSE_SWBP);
     }
+    catch (page_owners_t::stall_t&)
+    {
+      // The instruction at pc hasn't been executed, and will be again once
+      // the hart resumes in the serial phase
+      stall_traced = traced;
+      stalled_steps = n - instret;
+      n = instret;
+    }
     catch (wait_for_interrupt_t &t)
     {
       // Return to the outer simulation loop, which gives other devices/harts a
@@ -347,11 +383,19 @@ void processor_t::step(size_t n)
       //
       // In the debug ROM this prevents us from wasting time looping, but also
       // allows us to switch to other threads only once per idle loop in case
-      // there is activity.
+      // there is activity.  Outside debug mode, the hart then stays parked
+      // (see is_waiting_for_interrupt) until an enabled interrupt is
+      // pending; with none enabled, nothing could wake it, so WFI stays a
+      // no-op.
       n = ++instret;
+      in_wfi = !state.debug_mode && state.mie->read() != 0;
     }
 
     state.minstret->bump(instret);
+    if (unlikely(log_window_armed))
+      log_window_retired += instret;
+    if (unlikely(bbv != NULL))
+      bbv_end_step(instret);
 
     // Model a hart whose CPI is 1.
     state.mcycle->bump(instret);
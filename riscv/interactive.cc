@@ -10,6 +10,7 @@
 #include <iostream>
 #include <iomanip>
 #include <climits>
+#include <stdexcept>
 #include <cinttypes>
 #include <assert.h>
 #include <stdlib.h>
@@ -135,6 +136,7 @@ void sim_t::interactive()
   funcs["until"] = &sim_t::interactive_until_silent;
   funcs["untiln"] = &sim_t::interactive_until_noisy;
   funcs["while"] = &sim_t::interactive_until_silent;
+  funcs["save"] = &sim_t::interactive_save;
   funcs["quit"] = &sim_t::interactive_quit;
   funcs["q"] = funcs["quit"];
   funcs["help"] = &sim_t::interactive_help;
@@ -223,6 +225,7 @@ void sim_t::interactive_help(const std::string& cmd, const std::vector<std::stri
     "run [count]                     # Resume noisy execution (until CTRL+C, or [count] insns)\n"
     "r [count]                         Alias for run\n"
     "rs [count]                      # Resume silent execution (until CTRL+C, or [count] insns)\n"
+    "save <file>                     # Write a checkpoint to <file>, for --restore-checkpoint\n"
     "quit                            # End the simulation\n"
     "q                                 Alias for quit\n"
     "help                            # This screen!\n"
@@ -253,6 +256,19 @@ void sim_t::interactive_run(const std::string& cmd, const std::vector<std::strin
   if (!noisy) out << ":" << std::endl;
 }
 
+void sim_t::interactive_save(const std::string& cmd, const std::vector<std::string>& args)
+{
+  if (args.size() != 1)
+    throw trap_interactive();
+
+  try {
+    save_checkpoint(args[0]);
+  } catch (std::runtime_error& e) {
+    std::ostream out(sout_.rdbuf());
+    out << e.what() << std::endl;
+  }
+}
+
 void sim_t::interactive_quit(const std::string& cmd, const std::vector<std::string>& args)
 {
   exit(0);
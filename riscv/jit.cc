@@ -0,0 +1,603 @@
+// See LICENSE for license details.
+
+#include "jit.h"
+#include "processor.h"
+#include "mmu.h"
+#include "encoding.h"
+#include <string.h>
+#include <sys/mman.h>
+
+#if defined(__x86_64__)
+
+// x86-64 register numbers used by the generated code.  r10 holds the base
+// of the integer register file and r11 the address of state.pc; rax, rcx,
+// rdx and rsi are scratch.  Nothing callee-saved is touched, so translated
+// blocks need no prologue.
+enum { RAX = 0, RCX = 1, RDX = 2, RSI = 6 };
+
+// x86-64 condition codes
+enum { CC_B = 0x2, CC_AE = 0x3, CC_E = 0x4, CC_NE = 0x5, CC_L = 0xc, CC_GE = 0xd };
+
+enum jit_op_t {
+  OP_ADD, OP_SUB, OP_SLL, OP_SLT, OP_SLTU, OP_XOR, OP_SRL, OP_SRA, OP_OR,
+  OP_AND, OP_MUL, OP_LI, OP_LOAD, OP_STORE, OP_BRANCH, OP_JAL, OP_JALR,
+};
+
+// An instruction in the normalized form the code generator works from
+struct jit_insn_t {
+  jit_op_t op;
+  bool word;       // ALU op on the low 32 bits, sign-extended
+  bool has_imm;
+  reg_t rd, rs1, rs2;
+  int64_t imm;     // immediate, shift amount, or branch/jump target
+  size_t size;     // access size of loads and stores
+  bool is_signed;  // loads sign-extend
+  int cc;          // condition under which a branch is taken
+};
+
+static jit_insn_t alu(jit_op_t op, reg_t rd, reg_t rs1, reg_t rs2, bool word = false)
+{
+  return {op, word, false, rd, rs1, rs2, 0, 0, false, 0};
+}
+
+static jit_insn_t alu_imm(jit_op_t op, reg_t rd, reg_t rs1, int64_t imm, bool word = false)
+{
+  return {op, word, true, rd, rs1, 0, imm, 0, false, 0};
+}
+
+static jit_insn_t load(reg_t rd, reg_t rs1, int64_t imm, size_t size, bool is_signed)
+{
+  return {OP_LOAD, false, true, rd, rs1, 0, imm, size, is_signed, 0};
+}
+
+static jit_insn_t store(reg_t rs1, reg_t rs2, int64_t imm, size_t size)
+{
+  return {OP_STORE, false, true, 0, rs1, rs2, imm, size, false, 0};
+}
+
+static jit_insn_t branch(int cc, reg_t rs1, reg_t rs2, reg_t target)
+{
+  return {OP_BRANCH, false, true, 0, rs1, rs2, (int64_t)target, 0, false, cc};
+}
+
+static jit_insn_t jump(jit_op_t op, reg_t rd, reg_t rs1, int64_t imm)
+{
+  return {op, false, true, rd, rs1, 0, imm, 0, false, 0};
+}
+
+// Decode an RV64 instruction into normalized form.  Returns false for
+// anything the code generator doesn't handle, including every encoding the
+// interpreter would reject with an illegal-instruction trap.
+static bool decode(insn_t insn, reg_t pc, bool rvc, bool rvm, jit_insn_t* op)
+{
+  insn_bits_t bits = insn.bits();
+
+  if ((bits & 0x3) != 0x3) {
+    if (!rvc)
+      return false;
+
+    switch (((bits >> 11) & 0x1c) | (bits & 0x3)) {
+      case 0x00: // c.addi4spn
+        if (insn.rvc_addi4spn_imm() == 0)
+          return false;
+        *op = alu_imm(OP_ADD, insn.rvc_rs2s(), X_SP, insn.rvc_addi4spn_imm());
+        return true;
+      case 0x08: // c.lw
+        *op = load(insn.rvc_rs2s(), insn.rvc_rs1s(), insn.rvc_lw_imm(), 4, true);
+        return true;
+      case 0x0c: // c.ld
+        *op = load(insn.rvc_rs2s(), insn.rvc_rs1s(), insn.rvc_ld_imm(), 8, true);
+        return true;
+      case 0x18: // c.sw
+        *op = store(insn.rvc_rs1s(), insn.rvc_rs2s(), insn.rvc_lw_imm(), 4);
+        return true;
+      case 0x1c: // c.sd
+        *op = store(insn.rvc_rs1s(), insn.rvc_rs2s(), insn.rvc_ld_imm(), 8);
+        return true;
+      case 0x01: // c.addi
+        *op = alu_imm(OP_ADD, insn.rvc_rd(), insn.rvc_rs1(), insn.rvc_imm());
+        return true;
+      case 0x05: // c.addiw
+        if (insn.rvc_rd() == 0)
+          return false;
+        *op = alu_imm(OP_ADD, insn.rvc_rd(), insn.rvc_rs1(), insn.rvc_imm(), true);
+        return true;
+      case 0x09: // c.li
+        *op = alu_imm(OP_LI, insn.rvc_rd(), 0, insn.rvc_imm());
+        return true;
+      case 0x0d: // c.lui/c.addi16sp
+        if (insn.rvc_rd() == X_SP) {
+          if (insn.rvc_addi16sp_imm() == 0)
+            return false;
+          *op = alu_imm(OP_ADD, X_SP, X_SP, insn.rvc_addi16sp_imm());
+        } else {
+          if (insn.rvc_imm() == 0)
+            return false;
+          *op = alu_imm(OP_LI, insn.rvc_rd(), 0, insn.rvc_imm() << 12);
+        }
+        return true;
+      case 0x11: { // c.srli/c.srai/c.andi/c.sub/c.xor/c.or/c.and/c.subw/c.addw
+        reg_t rd = insn.rvc_rs1s(), rs2 = insn.rvc_rs2s();
+        switch ((bits >> 10) & 0x3) {
+          case 0: *op = alu_imm(OP_SRL, rd, rd, insn.rvc_zimm()); return true;
+          case 1: *op = alu_imm(OP_SRA, rd, rd, insn.rvc_zimm()); return true;
+          case 2: *op = alu_imm(OP_AND, rd, rd, insn.rvc_imm()); return true;
+        }
+        static const jit_op_t ops[] = {OP_SUB, OP_XOR, OP_OR, OP_AND, OP_SUB, OP_ADD};
+        size_t idx = ((bits >> 10) & 0x4) | ((bits >> 5) & 0x3);
+        if (idx >= sizeof(ops) / sizeof(ops[0]))
+          return false;
+        *op = alu(ops[idx], rd, rd, rs2, idx >= 4);
+        return true;
+      }
+      case 0x15: // c.j
+        *op = jump(OP_JAL, 0, 0, pc + insn.rvc_j_imm());
+        return true;
+      case 0x19: // c.beqz
+        *op = branch(CC_E, insn.rvc_rs1s(), 0, pc + insn.rvc_b_imm());
+        return true;
+      case 0x1d: // c.bnez
+        *op = branch(CC_NE, insn.rvc_rs1s(), 0, pc + insn.rvc_b_imm());
+        return true;
+      case 0x02: // c.slli
+        *op = alu_imm(OP_SLL, insn.rvc_rd(), insn.rvc_rs1(), insn.rvc_zimm());
+        return true;
+      case 0x0a: // c.lwsp
+        if (insn.rvc_rd() == 0)
+          return false;
+        *op = load(insn.rvc_rd(), X_SP, insn.rvc_lwsp_imm(), 4, true);
+        return true;
+      case 0x0e: // c.ldsp
+        if (insn.rvc_rd() == 0)
+          return false;
+        *op = load(insn.rvc_rd(), X_SP, insn.rvc_ldsp_imm(), 8, true);
+        return true;
+      case 0x12: // c.jr/c.mv/c.ebreak/c.jalr/c.add
+        if (insn.rvc_rs2() != 0) {
+          reg_t rs1 = (bits & 0x1000) ? insn.rvc_rs1() : 0;
+          *op = alu(OP_ADD, insn.rvc_rd(), rs1, insn.rvc_rs2());
+          return true;
+        }
+        if (insn.rvc_rs1() == 0)
+          return false;
+        *op = jump(OP_JALR, (bits & 0x1000) ? X_RA : 0, insn.rvc_rs1(), 0);
+        return true;
+      case 0x1a: // c.swsp
+        *op = store(X_SP, insn.rvc_rs2(), insn.rvc_swsp_imm(), 4);
+        return true;
+      case 0x1e: // c.sdsp
+        *op = store(X_SP, insn.rvc_rs2(), insn.rvc_sdsp_imm(), 8);
+        return true;
+      default:
+        return false;
+    }
+  }
+
+  #define DECODE_ALU(name, op_, word) \
+    if ((bits & MASK_##name) == MATCH_##name) { \
+      *op = alu(op_, insn.rd(), insn.rs1(), insn.rs2(), word); \
+      return true; \
+    }
+  #define DECODE_ALU_IMM(name, op_, imm, word) \
+    if ((bits & MASK_##name) == MATCH_##name) { \
+      *op = alu_imm(op_, insn.rd(), insn.rs1(), imm, word); \
+      return true; \
+    }
+  #define DECODE_LOAD(name, size, is_signed) \
+    if ((bits & MASK_##name) == MATCH_##name) { \
+      *op = load(insn.rd(), insn.rs1(), insn.i_imm(), size, is_signed); \
+      return true; \
+    }
+  #define DECODE_STORE(name, size) \
+    if ((bits & MASK_##name) == MATCH_##name) { \
+      *op = store(insn.rs1(), insn.rs2(), insn.s_imm(), size); \
+      return true; \
+    }
+  #define DECODE_BRANCH(name, cc) \
+    if ((bits & MASK_##name) == MATCH_##name) { \
+      *op = branch(cc, insn.rs1(), insn.rs2(), pc + insn.sb_imm()); \
+      return true; \
+    }
+
+  DECODE_ALU_IMM(ADDI, OP_ADD, insn.i_imm(), false)
+  DECODE_ALU_IMM(SLTI, OP_SLT, insn.i_imm(), false)
+  DECODE_ALU_IMM(SLTIU, OP_SLTU, insn.i_imm(), false)
+  DECODE_ALU_IMM(XORI, OP_XOR, insn.i_imm(), false)
+  DECODE_ALU_IMM(ORI, OP_OR, insn.i_imm(), false)
+  DECODE_ALU_IMM(ANDI, OP_AND, insn.i_imm(), false)
+  DECODE_ALU_IMM(SLLI, OP_SLL, insn.shamt(), false)
+  DECODE_ALU_IMM(SRLI, OP_SRL, insn.shamt(), false)
+  DECODE_ALU_IMM(SRAI, OP_SRA, insn.shamt(), false)
+  DECODE_ALU_IMM(ADDIW, OP_ADD, insn.i_imm(), true)
+  DECODE_ALU_IMM(SLLIW, OP_SLL, insn.shamt(), true)
+  DECODE_ALU_IMM(SRLIW, OP_SRL, insn.shamt(), true)
+  DECODE_ALU_IMM(SRAIW, OP_SRA, insn.shamt(), true)
+  DECODE_ALU_IMM(LUI, OP_LI, insn.u_imm(), false)
+  DECODE_ALU_IMM(AUIPC, OP_LI, pc + insn.u_imm(), false)
+
+  DECODE_ALU(ADD, OP_ADD, false)
+  DECODE_ALU(SUB, OP_SUB, false)
+  DECODE_ALU(SLL, OP_SLL, false)
+  DECODE_ALU(SLT, OP_SLT, false)
+  DECODE_ALU(SLTU, OP_SLTU, false)
+  DECODE_ALU(XOR, OP_XOR, false)
+  DECODE_ALU(SRL, OP_SRL, false)
+  DECODE_ALU(SRA, OP_SRA, false)
+  DECODE_ALU(OR, OP_OR, false)
+  DECODE_ALU(AND, OP_AND, false)
+  DECODE_ALU(ADDW, OP_ADD, true)
+  DECODE_ALU(SUBW, OP_SUB, true)
+  DECODE_ALU(SLLW, OP_SLL, true)
+  DECODE_ALU(SRLW, OP_SRL, true)
+  DECODE_ALU(SRAW, OP_SRA, true)
+  if (rvm) {
+    DECODE_ALU(MUL, OP_MUL, false)
+    DECODE_ALU(MULW, OP_MUL, true)
+  }
+
+  DECODE_LOAD(LB, 1, true)
+  DECODE_LOAD(LH, 2, true)
+  DECODE_LOAD(LW, 4, true)
+  DECODE_LOAD(LD, 8, true)
+  DECODE_LOAD(LBU, 1, false)
+  DECODE_LOAD(LHU, 2, false)
+  DECODE_LOAD(LWU, 4, false)
+
+  DECODE_STORE(SB, 1)
+  DECODE_STORE(SH, 2)
+  DECODE_STORE(SW, 4)
+  DECODE_STORE(SD, 8)
+
+  DECODE_BRANCH(BEQ, CC_E)
+  DECODE_BRANCH(BNE, CC_NE)
+  DECODE_BRANCH(BLT, CC_L)
+  DECODE_BRANCH(BGE, CC_GE)
+  DECODE_BRANCH(BLTU, CC_B)
+  DECODE_BRANCH(BGEU, CC_AE)
+
+  if ((bits & MASK_JAL) == MATCH_JAL) {
+    *op = jump(OP_JAL, insn.rd(), 0, pc + insn.uj_imm());
+    return true;
+  }
+
+  if ((bits & MASK_JALR) == MATCH_JALR) {
+    *op = jump(OP_JALR, insn.rd(), insn.rs1(), insn.i_imm());
+    return true;
+  }
+
+  #undef DECODE_ALU
+  #undef DECODE_ALU_IMM
+  #undef DECODE_LOAD
+  #undef DECODE_STORE
+  #undef DECODE_BRANCH
+
+  return false;
+}
+
+jit_t::jit_t(processor_t* proc)
+  : proc(proc), code_used(0)
+{
+  void* p = mmap(NULL, CODE_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  code = p == MAP_FAILED ? NULL : (uint8_t*)p;
+}
+
+jit_t::~jit_t()
+{
+  if (code)
+    munmap(code, CODE_SIZE);
+}
+
+bool jit_t::supported()
+{
+  return true;
+}
+
+bool jit_t::can_compile()
+{
+  return proc->xlen == 64 && !proc->extension_enabled('E') &&
+         !proc->mmu->is_target_big_endian();
+}
+
+void jit_t::emit32(uint32_t val)
+{
+  for (int i = 0; i < 4; i++)
+    emit(val >> (8 * i));
+}
+
+void jit_t::emit64(uint64_t val)
+{
+  emit32(val);
+  emit32(val >> 32);
+}
+
+void jit_t::emit_mov_imm(int reg, uint64_t val)
+{
+  emit(0x48);
+  if ((int64_t)val == (int32_t)val) {
+    emit(0xc7); emit(0xc0 | reg); emit32(val); // mov reg, simm32
+  } else {
+    emit(0xb8 | reg); emit64(val); // movabs reg, imm64
+  }
+}
+
+void jit_t::emit_load_xpr(int reg, reg_t xpr)
+{
+  if (xpr == 0) {
+    emit(0x31); emit(0xc0 | (reg << 3) | reg); // xor reg, reg
+  } else {
+    emit(0x49); emit(0x8b); emit(0x82 | (reg << 3)); emit32(xpr * sizeof(reg_t)); // mov reg, [r10 + disp32]
+  }
+}
+
+void jit_t::emit_store_xpr(reg_t xpr, int reg)
+{
+  if (xpr != 0) {
+    emit(0x49); emit(0x89); emit(0x82 | (reg << 3)); emit32(xpr * sizeof(reg_t)); // mov [r10 + disp32], reg
+  }
+}
+
+// Leave the block before instruction idx if condition cc holds
+void jit_t::emit_exit_if(int cc, size_t idx)
+{
+  emit(0x0f); emit(0x80 | cc); // jcc rel32
+  exits.push_back(std::make_pair(buf.size(), idx));
+  emit32(0);
+}
+
+void jit_t::emit_exit(reg_t npc, size_t retired)
+{
+  emit_mov_imm(RDX, npc);
+  emit(0x49); emit(0x89); emit(0x13); // mov [r11], rdx
+  emit(0xb8); emit32(retired);        // mov eax, retired
+  emit(0xc3);                         // ret
+}
+
+// Translate the effective address rs1 + imm through the TLB whose tags are
+// at tag, leaving the guest address in rcx and the host offset in rsi.
+// Misaligned accesses and TLB misses leave the block before instruction idx.
+void jit_t::emit_addr(reg_t rs1, int64_t imm, size_t size, size_t idx, const reg_t* tag)
+{
+  static_assert(mmu_t::TLB_ENTRIES == 256, "TLB index is taken from one byte");
+  static_assert(sizeof(tlb_entry_t) == 16, "TLB entries are 16 bytes");
+
+  emit_load_xpr(RCX, rs1);
+  if (imm != 0) {
+    emit(0x48); emit(0x81); emit(0xc1); emit32(imm); // add rcx, simm32
+  }
+  if (size > 1) {
+    emit(0xf6); emit(0xc1); emit(size - 1); // test cl, size-1
+    emit_exit_if(CC_NE, idx);
+  }
+  emit(0x48); emit(0x89); emit(0xca);             // mov rdx, rcx
+  emit(0x48); emit(0xc1); emit(0xea); emit(PGSHIFT); // shr rdx, PGSHIFT
+  emit(0x0f); emit(0xb6); emit(0xc2);             // movzx eax, dl
+  emit_mov_imm(RSI, (uintptr_t)tag);
+  emit(0x48); emit(0x39); emit(0x14); emit(0xc6); // cmp [rsi + rax*8], rdx
+  emit_exit_if(CC_NE, idx);
+  emit_mov_imm(RSI, (uintptr_t)&proc->mmu->tlb_data[0].host_offset);
+  emit(0xc1); emit(0xe0); emit(0x04);             // shl eax, 4
+  emit(0x48); emit(0x8b); emit(0x34); emit(0x06); // mov rsi, [rsi + rax]
+}
+
+// Generate code for the instruction at pc, whose fall-through PC is npc.
+// Returns false, having generated nothing, if the instruction can't be
+// translated; sets *done if it ended the block.
+bool jit_t::compile_insn(insn_t insn, reg_t pc, reg_t npc, size_t idx, bool* done)
+{
+  bool rvc = proc->extension_enabled('C');
+  bool rvm = proc->extension_enabled('M') || proc->extension_enabled(EXT_ZMMUL);
+  jit_insn_t op;
+
+  if (!decode(insn, pc, rvc, rvm, &op))
+    return false;
+
+  switch (op.op) {
+    case OP_LI:
+      if (op.rd != 0) {
+        emit_mov_imm(RAX, op.imm);
+        emit_store_xpr(op.rd, RAX);
+      }
+      break;
+
+    case OP_LOAD:
+      emit_addr(op.rs1, op.imm, op.size, idx, &proc->mmu->tlb_load_tag[0]);
+      switch (op.size) { // [rsi + rcx]
+        case 1: if (op.is_signed) emit(0x48); emit(0x0f); emit(op.is_signed ? 0xbe : 0xb6); break;
+        case 2: if (op.is_signed) emit(0x48); emit(0x0f); emit(op.is_signed ? 0xbf : 0xb7); break;
+        case 4: if (op.is_signed) emit(0x48); emit(op.is_signed ? 0x63 : 0x8b); break;
+        case 8: emit(0x48); emit(0x8b); break;
+      }
+      emit(0x04); emit(0x0e);
+      emit_store_xpr(op.rd, RAX);
+      break;
+
+    case OP_STORE:
+      emit_addr(op.rs1, op.imm, op.size, idx, &proc->mmu->tlb_store_tag[0]);
+      emit_load_xpr(RAX, op.rs2);
+      switch (op.size) { // mov [rsi + rcx], rax
+        case 1: emit(0x88); break;
+        case 2: emit(0x66); emit(0x89); break;
+        case 4: emit(0x89); break;
+        case 8: emit(0x48); emit(0x89); break;
+      }
+      emit(0x04); emit(0x0e);
+      break;
+
+    case OP_BRANCH:
+      if (!rvc && (op.imm & 2))
+        return false;
+      emit_load_xpr(RAX, op.rs1);
+      emit_load_xpr(RCX, op.rs2);
+      emit_mov_imm(RDX, npc);
+      emit_mov_imm(RSI, op.imm);
+      emit(0x48); emit(0x39); emit(0xc8);                 // cmp rax, rcx
+      emit(0x48); emit(0x0f); emit(0x40 | op.cc); emit(0xd6); // cmovcc rdx, rsi
+      emit(0x49); emit(0x89); emit(0x13);                 // mov [r11], rdx
+      emit(0xb8); emit32(idx + 1);                        // mov eax, idx+1
+      emit(0xc3);                                         // ret
+      *done = true;
+      break;
+
+    case OP_JAL:
+      if (!rvc && (op.imm & 2))
+        return false;
+      if (op.rd != 0) {
+        emit_mov_imm(RAX, npc);
+        emit_store_xpr(op.rd, RAX);
+      }
+      emit_exit(op.imm, idx + 1);
+      *done = true;
+      break;
+
+    case OP_JALR:
+      emit_load_xpr(RAX, op.rs1);
+      if (op.imm != 0) {
+        emit(0x48); emit(0x81); emit(0xc0); emit32(op.imm); // add rax, simm32
+      }
+      emit(0x48); emit(0x83); emit(0xe0); emit(0xfe); // and rax, -2
+      if (!rvc) {
+        emit(0xa8); emit(0x02); // test al, 2
+        emit_exit_if(CC_NE, idx);
+      }
+      if (op.rd != 0) {
+        emit_mov_imm(RCX, npc);
+        emit_store_xpr(op.rd, RCX);
+      }
+      emit(0x49); emit(0x89); emit(0x03); // mov [r11], rax
+      emit(0xb8); emit32(idx + 1);        // mov eax, idx+1
+      emit(0xc3);                         // ret
+      *done = true;
+      break;
+
+    default: // integer ALU ops
+      if (op.rd == 0)
+        break;
+
+      emit_load_xpr(RAX, op.rs1);
+      if (!op.has_imm)
+        emit_load_xpr(RCX, op.rs2);
+      if (!op.word)
+        emit(0x48); // REX.W
+      switch (op.op) {
+        case OP_ADD: // add rax, rcx/simm32
+          if (op.has_imm) { emit(0x81); emit(0xc0); emit32(op.imm); }
+          else { emit(0x01); emit(0xc8); }
+          break;
+        case OP_SUB: emit(0x29); emit(0xc8); break;
+        case OP_MUL: emit(0x0f); emit(0xaf); emit(0xc1); break;
+        case OP_XOR:
+          if (op.has_imm) { emit(0x81); emit(0xf0); emit32(op.imm); }
+          else { emit(0x31); emit(0xc8); }
+          break;
+        case OP_OR:
+          if (op.has_imm) { emit(0x81); emit(0xc8); emit32(op.imm); }
+          else { emit(0x09); emit(0xc8); }
+          break;
+        case OP_AND:
+          if (op.has_imm) { emit(0x81); emit(0xe0); emit32(op.imm); }
+          else { emit(0x21); emit(0xc8); }
+          break;
+        case OP_SLT:
+        case OP_SLTU: // cmp rax, rcx/simm32
+          if (op.has_imm) { emit(0x81); emit(0xf8); emit32(op.imm); }
+          else { emit(0x39); emit(0xc8); }
+          emit(0x0f); emit(0x90 | (op.op == OP_SLT ? CC_L : CC_B)); emit(0xc0); // setcc al
+          emit(0x0f); emit(0xb6); emit(0xc0); // movzx eax, al
+          break;
+        case OP_SLL:
+        case OP_SRL:
+        case OP_SRA: { // shift rax by cl/imm8
+          uint8_t ext = op.op == OP_SLL ? 0xe0 : op.op == OP_SRL ? 0xe8 : 0xf8;
+          if (op.has_imm) { emit(0xc1); emit(ext); emit(op.imm); }
+          else { emit(0xd3); emit(ext); }
+          break;
+        }
+        default:
+          abort();
+      }
+      if (op.word) {
+        emit(0x48); emit(0x63); emit(0xc0); // movsxd rax, eax
+      }
+      emit_store_xpr(op.rd, RAX);
+      break;
+  }
+
+  return true;
+}
+
+jit_code_t jit_t::compile(const iblock_t* block, reg_t pc)
+{
+  if (!code || !can_compile())
+    return NULL;
+
+  buf.clear();
+  exits.clear();
+
+  state_t* state = proc->get_state();
+  emit(0x49); emit(0xba); emit64((uintptr_t)&state->XPR[0]); // movabs r10, &XPR
+  emit(0x49); emit(0xbb); emit64((uintptr_t)&state->pc);     // movabs r11, &pc
+
+  // pcs[i] is the PC of the i'th instruction of the block
+  reg_t pcs[iblock_t::MAX_INSNS + 1];
+  pcs[0] = pc;
+  size_t len = 0;
+  bool done = false;
+  while (len < block->len && !done) {
+    pcs[len + 1] = block->insns[len].npc;
+    if (!compile_insn(block->insns[len].fetch.insn, pcs[len], pcs[len + 1], len, &done))
+      break;
+    len++;
+  }
+
+  if (len == 0)
+    return NULL;
+  if (!done)
+    emit_exit(pcs[len], len);
+
+  // Out-of-line exits taken from the middle of the block
+  std::vector<size_t> stubs(len + 1, 0);
+  for (auto exit : exits) {
+    size_t& stub = stubs[exit.second];
+    if (stub == 0) {
+      stub = buf.size();
+      emit_exit(pcs[exit.second], exit.second);
+    }
+    uint32_t rel = stub - (exit.first + 4);
+    memcpy(&buf[exit.first], &rel, sizeof(rel));
+  }
+
+  if (code_used + buf.size() > CODE_SIZE) {
+    // Out of space: throw away every translation and start over
+    proc->mmu->flush_icache();
+    code_used = 0;
+  }
+
+  uint8_t* entry = code + code_used;
+  memcpy(entry, &buf[0], buf.size());
+  code_used += buf.size();
+  return (jit_code_t)entry;
+}
+
+#else
+
+jit_t::jit_t(processor_t* proc)
+  : proc(proc), code(NULL), code_used(0)
+{
+}
+
+jit_t::~jit_t()
+{
+}
+
+bool jit_t::supported()
+{
+  return false;
+}
+
+jit_code_t jit_t::compile(const iblock_t* block, reg_t pc)
+{
+  return NULL;
+}
+
+#endif
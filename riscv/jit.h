@@ -0,0 +1,63 @@
+// See LICENSE for license details.
+
+#ifndef _RISCV_JIT_H
+#define _RISCV_JIT_H
+
+#include "decode.h"
+#include <vector>
+#include <stdint.h>
+
+class processor_t;
+struct iblock_t;
+
+// Translated code for one instruction block.  It returns the number of
+// instructions it retired and leaves the next PC in state.pc.  Translated
+// code never traps: it stops short of any instruction that might, so a
+// return value of 0 means nothing was executed.
+typedef size_t (*jit_code_t)();
+
+// A translator from hot RV64 integer blocks to x86-64 host code.  Only a
+// subset of RV64IMC is handled (integer ALU ops, loads and stores that hit
+// in the TLB, and control transfers that end a block); anything else is
+// left to the interpreter.
+class jit_t
+{
+public:
+  jit_t(processor_t* proc);
+  ~jit_t();
+
+  // Is a translator available for this host?
+  static bool supported();
+
+  // Translate block, which starts at pc.  Returns NULL if none of the block
+  // can be translated or translation is disabled by the current state.
+  jit_code_t compile(const iblock_t* block, reg_t pc);
+
+  // Interpret a block this many times before translating it
+  static const size_t HOT_THRESHOLD = 16;
+
+private:
+  processor_t* proc;
+  uint8_t* code;
+  size_t code_used;
+  static const size_t CODE_SIZE = 4 << 20;
+
+  // code being generated for the current block
+  std::vector<uint8_t> buf;
+  std::vector<std::pair<size_t, size_t>> exits; // (rel32 offset, insn index)
+
+  bool can_compile();
+  bool compile_insn(insn_t insn, reg_t pc, reg_t npc, size_t idx, bool* done);
+
+  void emit(uint8_t byte) { buf.push_back(byte); }
+  void emit32(uint32_t val);
+  void emit64(uint64_t val);
+  void emit_mov_imm(int reg, uint64_t val);
+  void emit_load_xpr(int reg, reg_t xpr);
+  void emit_store_xpr(reg_t xpr, int reg);
+  void emit_exit_if(int cc, size_t idx);
+  void emit_exit(reg_t npc, size_t retired);
+  void emit_addr(reg_t rs1, int64_t imm, size_t size, size_t idx, const reg_t* tag);
+};
+
+#endif
@@ -0,0 +1,153 @@
+// See LICENSE for license details.
+
+#include "log_writer.h"
+#include "processor.h"
+#include <cstring>
+#include <sstream>
+
+static size_t align(size_t len)
+{
+  return (len + 7) & ~size_t(7);
+}
+
+log_writer_t::log_writer_t(FILE* file, bool async)
+  : file(file), async(async), ring(NULL), head(0), tail(0),
+    waiting(false), stopping(false)
+{
+  if (async) {
+    ring = new uint8_t[RING_SIZE];
+    thread = std::thread(&log_writer_t::writer_main, this);
+  }
+}
+
+log_writer_t::~log_writer_t()
+{
+  if (async) {
+    stopping = true;
+    {
+      std::lock_guard<std::mutex> guard(lock);
+      wakeup.notify_one();
+    }
+    thread.join();
+    delete[] ring;
+  }
+  fflush(file);
+}
+
+void log_writer_t::write(const void* data, size_t len)
+{
+  append(RAW, data, len);
+}
+
+void log_writer_t::commit(const void* data, size_t len)
+{
+  append(COMMIT, data, len);
+}
+
+void log_writer_t::trace(processor_t* p, reg_t pc, insn_bits_t bits, uint64_t executions)
+{
+  trace_t t = {p, pc, bits, executions};
+  append(TRACE, &t, sizeof(t));
+}
+
+void log_writer_t::flush()
+{
+  if (async) {
+    while (tail.load(std::memory_order_acquire) != head.load(std::memory_order_relaxed))
+      std::this_thread::yield();
+  }
+  fflush(file);
+}
+
+void log_writer_t::append(kind_t kind, const void* data, size_t len)
+{
+  size_t size = sizeof(header_t) + align(len);
+
+  // Without a writer thread, or for a record too big for the ring (a commit
+  // record for a vector instruction with a very long VLEN), write it here,
+  // once the writer thread has written everything before it.
+  if (!async || size > RING_SIZE / 2) {
+    if (async)
+      flush();
+    process(kind, (const uint8_t*)data, len);
+    return;
+  }
+
+  // records are contiguous in the ring, so skip what's left at the end if
+  // this one doesn't fit there
+  size_t pos = head.load(std::memory_order_relaxed);
+  size_t pad = RING_SIZE - pos % RING_SIZE;
+  if (pad >= size)
+    pad = 0;
+
+  while (pos + pad + size - tail.load(std::memory_order_acquire) > RING_SIZE)
+    std::this_thread::yield();
+
+  if (pad) {
+    header_t* h = (header_t*)&ring[pos % RING_SIZE];
+    h->kind = PAD;
+    h->len = pad - sizeof(header_t);
+    pos += pad;
+  }
+
+  header_t* h = (header_t*)&ring[pos % RING_SIZE];
+  h->kind = kind;
+  h->len = len;
+  memcpy(h + 1, data, len);
+
+  // Publishing the record and then checking for a sleeping writer pairs
+  // with the writer announcing it's about to sleep and then checking for
+  // records; with both sequentially consistent, one of them sees the other.
+  head.store(pos + size);
+  if (waiting.load()) {
+    std::lock_guard<std::mutex> guard(lock);
+    wakeup.notify_one();
+  }
+}
+
+void log_writer_t::process(kind_t kind, const uint8_t* data, size_t len)
+{
+  switch (kind) {
+    case PAD:
+      break;
+    case RAW:
+      fwrite(data, 1, len, file);
+      break;
+    case COMMIT:
+      reader.feed(data, len);
+      while (reader.next())
+        reader.print(file);
+      break;
+    case TRACE: {
+      const trace_t* t = (const trace_t*)data;
+      std::stringstream s;
+      t->p->print_trace(s, t->pc, t->bits, t->executions);
+      fputs(s.str().c_str(), file);
+      break;
+    }
+  }
+}
+
+void log_writer_t::writer_main()
+{
+  while (true) {
+    size_t pos = tail.load(std::memory_order_relaxed);
+
+    if (pos == head.load(std::memory_order_acquire)) {
+      // let the file catch up while there's nothing else to do
+      fflush(file);
+
+      std::unique_lock<std::mutex> guard(lock);
+      waiting = true;
+      wakeup.wait(guard, [&]{ return head.load() != pos || stopping.load(); });
+      waiting = false;
+      if (head.load() == pos)
+        return;
+      continue;
+    }
+
+    const header_t* h = (const header_t*)&ring[pos % RING_SIZE];
+    process(kind_t(h->kind), (const uint8_t*)(h + 1), h->len);
+    tail.store(pos + sizeof(header_t) + align(h->len), std::memory_order_release);
+  }
+}
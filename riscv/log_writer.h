@@ -0,0 +1,75 @@
+// See LICENSE for license details.
+#ifndef _RISCV_LOG_WRITER_H
+#define _RISCV_LOG_WRITER_H
+
+#include "decode.h"
+#include "commit_log.h"
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+class processor_t;
+
+// The sink for log output.  Records are formatted and written in the order
+// they arrive.  If the writer is asynchronous (--log-async), the simulation
+// thread only copies raw records into a single-producer, single-consumer
+// ring, and a writer thread formats them and writes them to the file; when
+// the ring is full the simulation thread waits for the writer to catch up.
+// Otherwise each record is written as soon as it arrives.
+class log_writer_t
+{
+public:
+  log_writer_t(FILE* file, bool async);
+  ~log_writer_t();
+
+  // Bytes to be written as is
+  void write(const void* data, size_t len);
+
+  // One instruction record of a binary commit log, to be printed in the text
+  // format.  Successive records form one stream, as in a binary log file.
+  void commit(const void* data, size_t len);
+
+  // One line of the -l instruction trace; see processor_t::print_trace
+  void trace(processor_t* p, reg_t pc, insn_bits_t bits, uint64_t executions);
+
+  // Wait until everything logged so far has been written
+  void flush();
+
+private:
+  enum kind_t { PAD, RAW, COMMIT, TRACE };
+
+  struct header_t {
+    uint32_t kind;
+    uint32_t len;
+  };
+
+  struct trace_t {
+    processor_t* p;
+    reg_t pc;
+    insn_bits_t bits;
+    uint64_t executions;
+  };
+
+  static const size_t RING_SIZE = 1 << 20;
+
+  FILE* file;
+  binary_commit_log_reader_t reader;
+
+  bool async;
+  uint8_t* ring;
+  std::atomic<size_t> head; // bytes appended, written only by the producer
+  std::atomic<size_t> tail; // bytes consumed, written only by the writer
+  std::atomic<bool> waiting;
+  std::atomic<bool> stopping;
+  std::mutex lock;
+  std::condition_variable wakeup;
+  std::thread thread;
+
+  void append(kind_t kind, const void* data, size_t len);
+  void process(kind_t kind, const uint8_t* data, size_t len);
+  void writer_main();
+};
+
+#endif
@@ -6,7 +6,8 @@
 #include "processor.h"
 
 mmu_t::mmu_t(simif_t* sim, processor_t* proc)
- : sim(sim), proc(proc),
+ : sim(sim), proc(proc), load_reservation_value(0), concurrent(false),
+  page_owners(NULL), page_owner_hart(0), iblock_break(-1),
 #ifdef RISCV_ENABLE_DUAL_ENDIAN
   target_big_endian(false),
 #endif
@@ -25,17 +26,20 @@ mmu_t::~mmu_t()
 
 void mmu_t::flush_icache()
 {
-  for (size_t i = 0; i < ICACHE_ENTRIES; i++)
-    icache[i].tag = -1;
+  memset(iblock_tag, -1, sizeof(iblock_tag));
 }
 
 void mmu_t::flush_tlb()
+{
+  flush_tlb_entries();
+  flush_icache();
+}
+
+void mmu_t::flush_tlb_entries()
 {
   memset(tlb_insn_tag, -1, sizeof(tlb_insn_tag));
   memset(tlb_load_tag, -1, sizeof(tlb_load_tag));
   memset(tlb_store_tag, -1, sizeof(tlb_store_tag));
-
-  flush_icache();
 }
 
 static void throw_access_exception(bool virt, reg_t addr, access_type type)
@@ -79,6 +83,7 @@ tlb_entry_t mmu_t::fetch_slow_path(reg_t vaddr)
   reg_t paddr = translate(vaddr, sizeof(fetch_temp), FETCH, 0);
 
   if (auto host_addr = sim->addr_to_mem(paddr)) {
+    check_page_owner(paddr, FETCH);
     return refill_tlb(vaddr, paddr, host_addr, FETCH);
   } else {
     if (!mmio_load(paddr, sizeof fetch_temp, (uint8_t*)&fetch_temp))
@@ -127,6 +132,8 @@ bool mmu_t::mmio_load(reg_t addr, size_t len, uint8_t* bytes)
 {
   if (!mmio_ok(addr, LOAD))
     return false;
+  if (unlikely(page_owners != NULL))
+    page_owners->access_device();
 
   return sim->mmio_load(addr, len, bytes);
 }
@@ -135,6 +142,8 @@ bool mmu_t::mmio_store(reg_t addr, size_t len, const uint8_t* bytes)
 {
   if (!mmio_ok(addr, STORE))
     return false;
+  if (unlikely(page_owners != NULL))
+    page_owners->access_device();
 
   return sim->mmio_store(addr, len, bytes);
 }
@@ -144,6 +153,7 @@ void mmu_t::load_slow_path(reg_t addr, reg_t len, uint8_t* bytes, uint32_t xlate
   reg_t paddr = translate(addr, len, LOAD, xlate_flags);
 
   if (auto host_addr = sim->addr_to_mem(paddr)) {
+    check_page_owner(paddr, LOAD);
     memcpy(bytes, host_addr, len);
     if (tracer.interested_in_range(paddr, paddr + PGSIZE, LOAD))
       tracer.trace(paddr, len, LOAD);
@@ -174,6 +184,7 @@ void mmu_t::store_slow_path(reg_t addr, reg_t len, const uint8_t* bytes, uint32_
 
   if (actually_store) {
     if (auto host_addr = sim->addr_to_mem(paddr)) {
+      check_page_owner(paddr, STORE);
       memcpy(host_addr, bytes, len);
       if (tracer.interested_in_range(paddr, paddr + PGSIZE, STORE))
         tracer.trace(paddr, len, STORE);
@@ -291,6 +302,7 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
       if (!ppte || !pmp_ok(pte_paddr, vm.ptesize, LOAD, PRV_S)) {
         throw_access_exception(virt, gva, trap_type);
       }
+      check_page_owner(pte_paddr, LOAD);
 
       reg_t pte = vm.ptesize == 4 ? from_target(*(target_endian<uint32_t>*)ppte) : from_target(*(target_endian<uint64_t>*)ppte);
       reg_t ppn = (pte & ~reg_t(PTE_ATTR)) >> PTE_PPN_SHIFT;
@@ -325,6 +337,7 @@ reg_t mmu_t::s2xlate(reg_t gva, reg_t gpa, access_type type, access_type trap_ty
         if ((pte & ad) != ad) {
           if (!pmp_ok(pte_paddr, vm.ptesize, STORE, PRV_S))
             throw_access_exception(virt, gva, trap_type);
+          check_page_owner(pte_paddr, STORE);
           *(target_endian<uint32_t>*)ppte |= to_target((uint32_t)ad);
         }
 #else
@@ -384,6 +397,7 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
     auto ppte = sim->addr_to_mem(pte_paddr);
     if (!ppte || !pmp_ok(pte_paddr, vm.ptesize, LOAD, PRV_S))
       throw_access_exception(virt, addr, type);
+    check_page_owner(pte_paddr, LOAD);
 
     reg_t pte = vm.ptesize == 4 ? from_target(*(target_endian<uint32_t>*)ppte) : from_target(*(target_endian<uint64_t>*)ppte);
     reg_t ppn = (pte & ~reg_t(PTE_ATTR)) >> PTE_PPN_SHIFT;
@@ -418,6 +432,7 @@ reg_t mmu_t::walk(reg_t addr, access_type type, reg_t mode, bool virt, bool hlvx
       if ((pte & ad) != ad) {
         if (!pmp_ok(pte_paddr, vm.ptesize, STORE, PRV_S))
           throw_access_exception(virt, addr, type);
+        check_page_owner(pte_paddr, STORE);
         *(target_endian<uint32_t>*)ppte |= to_target((uint32_t)ad);
       }
 #else
@@ -12,6 +12,8 @@
 #include "memtracer.h"
 #include "byteorder.h"
 #include "triggers.h"
+#include "jit.h"
+#include "page_owners.h"
 #include <stdlib.h>
 #include <vector>
 
@@ -27,10 +29,18 @@ struct insn_fetch_t
   insn_t insn;
 };
 
-struct icache_entry_t {
-  reg_t tag;
-  struct icache_entry_t* next;
-  insn_fetch_t data;
+// A straight-line run of decoded instructions.  The fast path executes a
+// whole block without looking each instruction up individually.
+struct iblock_t {
+  static const size_t MAX_INSNS = 16;
+  size_t len;
+  size_t execs; // times interpreted, until translated
+  jit_code_t jit_code; // translation, or NULL
+  uint32_t bbv_block; // its basic block in the --bbv profile, or -1 if not looked up
+  struct {
+    insn_fetch_t fetch;
+    reg_t npc; // fall-through PC
+  } insns[MAX_INSNS];
 };
 
 struct tlb_entry_t {
@@ -90,12 +100,10 @@ public:
 #endif
   }
 
-#ifndef RISCV_ENABLE_COMMITLOG
-# define READ_MEM(addr, size) ({})
-#else
-# define READ_MEM(addr, size) \
-  proc->state.log_mem_read.push_back(std::make_tuple(addr, 0, size));
-#endif
+#define READ_MEM(addr, size) ({ \
+    if (unlikely(proc->get_log_commits_enabled())) \
+      proc->state.log_mem_read.push_back(std::make_tuple(addr, 0, size)); \
+  })
 
   // template for functions that load an aligned value from memory
   #define load_func(type, prefix, xlate_flags) \
@@ -153,12 +161,10 @@ public:
   load_func(int32, guest_load, RISCV_XLATE_VIRT)
   load_func(int64, guest_load, RISCV_XLATE_VIRT)
 
-#ifndef RISCV_ENABLE_COMMITLOG
-# define WRITE_MEM(addr, value, size) ({})
-#else
-# define WRITE_MEM(addr, val, size) \
-  proc->state.log_mem_write.push_back(std::make_tuple(addr, val, size));
-#endif
+#define WRITE_MEM(addr, val, size) ({ \
+    if (unlikely(proc->get_log_commits_enabled())) \
+      proc->state.log_mem_write.push_back(std::make_tuple(addr, val, size)); \
+  })
 
   // template for functions that store an aligned value to memory
   #define store_func(type, prefix, xlate_flags) \
@@ -214,12 +220,28 @@ public:
     type##_t amo_##type(reg_t addr, op f) { \
       convert_load_traps_to_store_traps({ \
         store_##type(addr, 0, false, true); \
+        if (unlikely(concurrent)) \
+          if (auto host = host_store_addr<type##_t>(addr)) \
+            return host_amo(addr, host, f); \
         auto lhs = load_##type(addr, true); \
         store_##type(addr, f(lhs)); \
         return lhs; \
       }) \
     }
 
+  // template for functions that perform a store conditional: they store val
+  // and return true if this hart still holds a reservation on addr
+  #define store_conditional_func(type) \
+    bool store_conditional_##type(reg_t addr, type##_t val) { \
+      if (!check_load_reservation(addr, sizeof(type##_t))) \
+        return false; \
+      if (unlikely(concurrent)) \
+        if (auto host = host_store_addr<type##_t>(addr)) \
+          return host_cas(addr, host, type##_t(load_reservation_value), val); \
+      store_##type(addr, val); \
+      return true; \
+    }
+
   void store_float128(reg_t addr, float128_t val)
   {
 #ifndef RISCV_ENABLE_MISALIGNED
@@ -255,6 +277,10 @@ public:
   amo_func(uint32)
   amo_func(uint64)
 
+  // store conditionally at an aligned address
+  store_conditional_func(uint32)
+  store_conditional_func(uint64)
+
   void cbo_zero(reg_t addr) {
     auto base = addr & ~(blocksz - 1);
     for (size_t offset = 0; offset < blocksz; offset += 1)
@@ -279,12 +305,15 @@ public:
     load_reservation_address = (reg_t)-1;
   }
 
-  inline void acquire_load_reservation(reg_t vaddr)
+  // val is the value the LR read, which a concurrent SC checks is still there
+  inline void acquire_load_reservation(reg_t vaddr, reg_t val)
   {
     reg_t paddr = translate(vaddr, 1, LOAD, 0);
-    if (auto host_addr = sim->addr_to_mem(paddr))
+    if (auto host_addr = sim->addr_to_mem(paddr)) {
+      check_page_owner(paddr, LOAD);
       load_reservation_address = refill_tlb(vaddr, paddr, host_addr, LOAD).target_offset + vaddr;
-    else
+      load_reservation_value = val;
+    } else
       throw trap_load_access_fault((proc) ? proc->state.v : false, vaddr, 0, 0); // disallow LR to I/O space
   }
 
@@ -314,20 +343,21 @@ public:
       store_conditional_address_misaligned(vaddr);
 
     reg_t paddr = translate(vaddr, 1, STORE, 0);
-    if (auto host_addr = sim->addr_to_mem(paddr))
+    if (auto host_addr = sim->addr_to_mem(paddr)) {
+      check_page_owner(paddr, STORE);
       return load_reservation_address == refill_tlb(vaddr, paddr, host_addr, STORE).target_offset + vaddr;
-    else
+    } else
       throw trap_store_access_fault((proc) ? proc->state.v : false, vaddr, 0, 0); // disallow SC to I/O space
   }
 
-  static const reg_t ICACHE_ENTRIES = 1024;
+  static const reg_t IBLOCK_ENTRIES = 1024;
 
-  inline size_t icache_index(reg_t addr)
+  inline size_t iblock_index(reg_t addr)
   {
-    return (addr / PC_ALIGN) % ICACHE_ENTRIES;
+    return (addr / PC_ALIGN) % IBLOCK_ENTRIES;
   }
 
-  inline icache_entry_t* refill_icache(reg_t addr, icache_entry_t* entry)
+  inline insn_fetch_t fetch_insn(reg_t addr, reg_t* paddr)
   {
     auto tlb_entry = translate_insn_addr(addr);
     insn_bits_t insn = from_le(*(uint16_t*)(tlb_entry.host_offset + addr));
@@ -347,35 +377,124 @@ public:
       insn |= (insn_bits_t)from_le(*(const uint16_t*)translate_insn_addr_to_host(addr + 2)) << 16;
     }
 
-    insn_fetch_t fetch = {proc->decode_insn(insn), insn};
-    entry->tag = addr;
-    entry->next = &icache[icache_index(addr + length)];
-    entry->data = fetch;
+    *paddr = tlb_entry.target_offset + addr;
+    return {proc->decode_insn(insn), insn};
+  }
+
+  // Instructions that may redirect control flow, flush the instruction
+  // cache or TLB, or otherwise change how later instructions decode
+  // terminate a block.  (Custom opcodes are included conservatively.)
+  inline bool ends_iblock(insn_bits_t insn)
+  {
+    if ((insn & 0x3) != 0x3) {
+      switch (((insn >> 11) & 0x1c) | (insn & 0x3)) {
+        case 0x05: // c.jal (RV32), c.addiw (RV64)
+          return proc->get_xlen() == 32;
+        case 0x15: // c.j
+        case 0x19: // c.beqz
+        case 0x1d: // c.bnez
+          return true;
+        case 0x12: // c.jr/c.jalr/c.ebreak, unless c.mv/c.add
+          return ((insn >> 2) & 0x1f) == 0;
+        default:
+          return false;
+      }
+    }
+
+    switch (insn & 0x7f) {
+      case 0x0b: // custom-0
+      case 0x0f: // MISC-MEM
+      case 0x2b: // custom-1
+      case 0x5b: // custom-2
+      case 0x63: // BRANCH
+      case 0x67: // JALR
+      case 0x6f: // JAL
+      case 0x73: // SYSTEM
+      case 0x7b: // custom-3
+        return true;
+      default:
+        return false;
+    }
+  }
 
-    reg_t paddr = tlb_entry.target_offset + addr;;
-    if (tracer.interested_in_range(paddr, paddr + 1, FETCH)) {
-      entry->tag = -1;
-      tracer.trace(paddr, length, FETCH);
+  // Can the instruction at addr be fetched from the ITLB without side
+  // effects (slow-path translation, MMIO access, or trigger match)?
+  inline bool iblock_can_extend(reg_t addr)
+  {
+    reg_t vpn = addr >> PGSHIFT;
+    if (tlb_insn_tag[vpn % TLB_ENTRIES] != vpn)
+      return false;
+    auto host_addr = (const uint16_t*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr);
+    return (addr % PGSIZE) + insn_length(from_le(*host_addr)) <= PGSIZE;
+  }
+
+  inline iblock_t* refill_iblock(reg_t addr)
+  {
+    size_t idx = iblock_index(addr);
+    iblock_t* block = &iblocks[idx];
+    reg_t pc = addr, paddr;
+    size_t len = 0;
+
+    iblock_tag[idx] = -1;
+    block->execs = 0;
+    block->jit_code = NULL;
+    block->bbv_block = -1;
+    while (true) {
+      insn_fetch_t fetch = fetch_insn(pc, &paddr);
+      int length = fetch.insn.length();
+
+      // Fetches a memory tracer wants to see are never cached
+      if (tracer.interested_in_range(paddr, paddr + 1, FETCH)) {
+        if (len == 0) {
+          tracer.trace(paddr, length, FETCH);
+          block->insns[0] = {fetch, pc + length};
+          block->len = 1;
+          return block;
+        }
+        break;
+      }
+
+      pc += length;
+      block->insns[len++] = {fetch, pc};
+      if (len == iblock_t::MAX_INSNS || ends_iblock(fetch.insn.bits()) ||
+          (pc ^ addr) >= PGSIZE || pc == iblock_break || !iblock_can_extend(pc))
+        break;
     }
-    return entry;
+
+    iblock_tag[idx] = addr;
+    block->len = len;
+    return block;
   }
 
-  inline icache_entry_t* access_icache(reg_t addr)
+  inline iblock_t* access_iblock(reg_t addr)
   {
-    icache_entry_t* entry = &icache[icache_index(addr)];
-    if (likely(entry->tag == addr))
-      return entry;
-    return refill_icache(addr, entry);
+    size_t idx = iblock_index(addr);
+    if (likely(iblock_tag[idx] == addr))
+      return &iblocks[idx];
+    return refill_iblock(addr);
   }
 
   inline insn_fetch_t load_insn(reg_t addr)
   {
-    icache_entry_t entry;
-    return refill_icache(addr, &entry)->data;
+    reg_t paddr;
+    insn_fetch_t fetch = fetch_insn(addr, &paddr);
+    if (tracer.interested_in_range(paddr, paddr + 1, FETCH))
+      tracer.trace(paddr, fetch.insn.length(), FETCH);
+    return fetch;
   }
 
   void flush_tlb();
   void flush_icache();
+  // Forget translations, but keep the decoded instructions
+  void flush_tlb_entries();
+
+  // Make pc always start a block, so the fast path can watch for it by
+  // checking only block entry points.  -1 means no such PC.
+  void set_iblock_break(reg_t pc)
+  {
+    iblock_break = pc;
+    flush_icache();
+  }
 
   void register_memtracer(memtracer_t*);
 
@@ -421,6 +540,20 @@ public:
     return target_big_endian? target_endian<T>::to_be(n) : target_endian<T>::to_le(n);
   }
 
+  // Other harts run at the same time as this one, on other host threads, so
+  // AMOs and SCs must be atomic on the host too
+  void set_concurrent(bool value)
+  {
+    concurrent = value;
+  }
+
+  // Check accesses against page owners, as hart
+  void set_page_owners(page_owners_t* owners, size_t hart)
+  {
+    page_owners = owners;
+    page_owner_hart = hart;
+  }
+
   void set_cache_blocksz(uint64_t size)
   {
     blocksz = size;
@@ -431,11 +564,17 @@ private:
   processor_t* proc;
   memtracer_list_t tracer;
   reg_t load_reservation_address;
+  reg_t load_reservation_value;
+  bool concurrent;
+  page_owners_t* page_owners;
+  size_t page_owner_hart;
   uint16_t fetch_temp;
   uint64_t blocksz;
 
   // implement an instruction cache for simulator performance
-  icache_entry_t icache[ICACHE_ENTRIES];
+  reg_t iblock_tag[IBLOCK_ENTRIES];
+  iblock_t iblocks[IBLOCK_ENTRIES];
+  reg_t iblock_break;
 
   // implement a TLB for simulator performance
   static const reg_t TLB_ENTRIES = 256;
@@ -447,6 +586,58 @@ private:
   reg_t tlb_load_tag[TLB_ENTRIES];
   reg_t tlb_store_tag[TLB_ENTRIES];
 
+  // The host address of an aligned T at addr, if it's in the store TLB and
+  // needn't be checked for triggers, or NULL
+  template<typename T> T* host_store_addr(reg_t addr)
+  {
+    reg_t vpn = addr >> PGSHIFT;
+    if (tlb_store_tag[vpn % TLB_ENTRIES] != vpn)
+      return NULL;
+    return (T*)(tlb_data[vpn % TLB_ENTRIES].host_offset + addr);
+  }
+
+  // An AMO, or an SC that succeeds only if memory still holds expected, done
+  // with a host atomic on the T at host
+  template<typename T, typename op> T host_amo(reg_t addr, T* host, op f)
+  {
+    T old = __atomic_load_n(host, __ATOMIC_SEQ_CST), lhs, rhs;
+    do {
+      lhs = from_target_bits(old);
+      rhs = f(lhs);
+    } while (!__atomic_compare_exchange_n(host, &old, to_target_bits(rhs),
+                                          false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST));
+    if (proc) READ_MEM(addr, sizeof(T));
+    if (proc) WRITE_MEM(addr, rhs, sizeof(T));
+    return lhs;
+  }
+
+  template<typename T> bool host_cas(reg_t addr, T* host, T expected, T val)
+  {
+    T old = to_target_bits(expected);
+    if (!__atomic_compare_exchange_n(host, &old, to_target_bits(val),
+                                     false, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST))
+      return false;
+    if (proc) WRITE_MEM(addr, val, sizeof(T));
+    return true;
+  }
+
+  // n as it's laid out in target memory, and back
+  template<typename T> T to_target_bits(T n) const
+  {
+    return target_big_endian ? ::to_be(n) : ::to_le(n);
+  }
+
+  template<typename T> T from_target_bits(T n) const
+  {
+    return target_big_endian ? ::from_be(n) : ::from_le(n);
+  }
+
+  inline void check_page_owner(reg_t paddr, access_type type)
+  {
+    if (unlikely(page_owners != NULL))
+      page_owners->access(page_owner_hart, paddr, type);
+  }
+
   // finish translation on a TLB miss and update the TLB
   tlb_entry_t refill_tlb(reg_t vaddr, reg_t paddr, char* host_addr, access_type type);
   const char* fill_from_mmio(reg_t vaddr, reg_t paddr);
@@ -523,6 +714,7 @@ private:
   triggers::matched_t *matched_trigger;
 
   friend class processor_t;
+  friend class jit_t;
 };
 
 struct vm_info {
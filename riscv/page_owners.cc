@@ -0,0 +1,51 @@
+// See LICENSE for license details.
+
+#include "page_owners.h"
+#include "mmu.h"
+
+page_owners_t::page_owners_t(size_t nharts)
+  : revoked(nharts), parallel(false)
+{
+}
+
+void page_owners_t::access(size_t hart, reg_t paddr, access_type type)
+{
+  reg_t ppn = paddr >> PGSHIFT;
+
+  // In the parallel phase, all the harts look pages up at once, so leave
+  // the map alone
+  const auto& map = owners;
+  auto it = map.find(ppn);
+  size_t owner = it == map.end() ? NO_OWNER : it->second;
+
+  if (owner == hart || (owner == SHARED && type != STORE))
+    return;
+  if (parallel)
+    throw stall_t();
+
+  // A page's first reader owns it, so that pages only one hart uses, like
+  // its stack, don't stall it when it writes them
+  revoke(owner);
+  owners[ppn] = type == STORE || owner == NO_OWNER ? hart : SHARED;
+}
+
+void page_owners_t::access_device()
+{
+  if (parallel)
+    throw stall_t();
+}
+
+bool page_owners_t::take_revoked(size_t hart)
+{
+  bool value = revoked[hart];
+  revoked[hart] = false;
+  return value;
+}
+
+void page_owners_t::revoke(size_t owner)
+{
+  if (owner == SHARED)
+    revoked.assign(revoked.size(), true);
+  else if (owner != NO_OWNER)
+    revoked[owner] = true;
+}
@@ -0,0 +1,55 @@
+// See LICENSE for license details.
+#ifndef _RISCV_PAGE_OWNERS_H
+#define _RISCV_PAGE_OWNERS_H
+
+#include "decode.h"
+#include "memtracer.h"
+#include <unordered_map>
+#include <vector>
+
+// Which hart may touch each page of memory, for deterministic mode
+// (--deterministic).  Each round of that mode has two phases:
+//
+//  - In the parallel phase, the harts run their quanta on their threads.  A
+//    hart may only touch pages that it owns, which no other hart touches,
+//    and read pages that are shared, which no hart writes; it stalls before
+//    any other access, and before any access to a device.
+//  - In the serial phase, the harts that stalled finish their quanta one at
+//    a time, in hart order, and each access hands pages over: a write makes
+//    the writer the owner, and a read by another hart makes a page shared.
+//
+// A hart so never sees what another writes in the same parallel phase, and
+// a run is the same however the host schedules the threads, or how many
+// there are.  Harts keep pages in their TLBs only while they may touch them,
+// so only TLB refills need checking.
+class page_owners_t
+{
+public:
+  page_owners_t(size_t nharts);
+
+  // Thrown in the parallel phase by an access the hart must stall before
+  class stall_t {};
+
+  void set_parallel(bool value) { parallel = value; }
+
+  // hart accesses the page at paddr
+  void access(size_t hart, reg_t paddr, access_type type);
+  // A hart accesses a device
+  void access_device();
+
+  // Did hart lose access to a page in the serial phase?  It must then flush
+  // its TLB before the next parallel phase.  Clears the flag.
+  bool take_revoked(size_t hart);
+
+private:
+  static const size_t NO_OWNER = -1;
+  static const size_t SHARED = -2;
+
+  std::unordered_map<reg_t, size_t> owners; // by page number
+  std::vector<bool> revoked;
+  bool parallel;
+
+  void revoke(size_t owner);
+};
+
+#endif
@@ -8,6 +8,9 @@
 #include "simif.h"
 #include "mmu.h"
 #include "disasm.h"
+#include "log_writer.h"
+#include "checkpoint.h"
+#include "bbv.h"
 #include "platform.h"
 #include <cinttypes>
 #include <cmath>
@@ -26,10 +29,15 @@
 processor_t::processor_t(const isa_parser_t *isa, const char* varch,
                          simif_t* sim, uint32_t id, bool halt_on_reset,
                          FILE* log_file, std::ostream& sout_)
-  : debug(false), halt_request(HR_NONE), isa(isa), sim(sim), id(id), xlen(0),
-  histogram_enabled(false), log_commits_enabled(false),
-  log_file(log_file), sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
-  impl_table(256, false), last_pc(1), executions(1), TM(4)
+  : debug(false), halt_request(HR_NONE), isa(isa), sim(sim), jit(NULL), id(id), xlen(0),
+  histogram_enabled(false), log_commits_enabled(false), commit_log_bin(NULL),
+  log_writer(NULL),
+  log_file(log_file), log_window_armed(false),
+  log_window_trace(false), log_window_commits(false),
+  bbv(NULL), bbv_block(-1), bbv_block_entered(0), bbv_resume_pc(-1), bbv_retired(0),
+  stalled_steps(0), in_wfi(false), stall_traced(false),
+  sout_(sout_.rdbuf()), halt_on_reset(halt_on_reset),
+  impl_table(256, false), decode_misses(0), last_pc(1), executions(1), TM(4)
 {
   VU.p = this;
   TM.proc = this;
@@ -69,12 +77,14 @@ processor_t::~processor_t()
 #ifdef RISCV_ENABLE_HISTOGRAM
   if (histogram_enabled)
   {
+    fprintf(stderr, "Decode misses:%" PRIu64 "\n", decode_misses);
     fprintf(stderr, "PC Histogram size:%zu\n", pc_histogram.size());
     for (auto it : pc_histogram)
       fprintf(stderr, "%0" PRIx64 " %" PRIu64 "\n", it.first, it.second);
   }
 #endif
 
+  delete jit;
   delete mmu;
   delete disassembler;
 }
@@ -459,14 +469,12 @@ void state_t::reset(processor_t* const proc, reg_t max_isa)
 
   serialized = false;
 
-#ifdef RISCV_ENABLE_COMMITLOG
   log_reg_write.clear();
   log_mem_read.clear();
   log_mem_write.clear();
   last_inst_priv = 0;
   last_inst_xlen = 0;
   last_inst_flen = 0;
-#endif
 }
 
 void processor_t::vectorUnit_t::reset()
@@ -549,19 +557,142 @@ void processor_t::set_histogram(bool value)
 #endif
 }
 
-#ifdef RISCV_ENABLE_COMMITLOG
-void processor_t::enable_log_commits()
+void processor_t::set_jit(bool value)
+{
+  if (value && !jit_t::supported()) {
+    fprintf(stderr, "Block translation is not supported on this host.\n");
+    abort();
+  }
+
+  delete jit;
+  jit = value ? new jit_t(this) : NULL;
+  mmu->flush_icache();
+}
+
+void processor_t::enable_log_commits(binary_commit_log_t* bin)
 {
   log_commits_enabled = true;
+  commit_log_bin = bin;
+  build_dispatch_table();
+  mmu->flush_icache();
+}
+
+void processor_t::set_log_window(const log_window_t& window)
+{
+  log_window = window;
+  log_window_armed = true;
+  log_window_started = false;
+  log_window_trace |= debug;
+  log_window_commits |= log_commits_enabled;
+  log_window_retired = 0;
+  log_window_logged = 0;
+  log_window_opened = 0;
+  log_window_open = true;
+  set_log_window_open(false, 0);
+  mmu->set_iblock_break(window.start_pc);
+}
+
+void processor_t::set_log_window_open(bool open, reg_t retired)
+{
+  if (open)
+    log_window_opened = retired;
+  else if (log_window_open)
+    log_window_logged += retired - log_window_opened;
+  log_window_open = open;
+
+  debug = open && log_window_trace;
+  if (log_window_commits) {
+    log_commits_enabled = open;
+    build_dispatch_table();
+    mmu->flush_icache();
+  }
+}
+
+void processor_t::set_bbv_profile(bbv_profile_t* profile)
+{
+  bbv = profile;
+  bbv_block = bbv_profile_t::NO_BLOCK;
+  bbv_block_entered = 0;
+  bbv_resume_pc = -1;
+  bbv_retired = 0;
+  mmu->flush_icache();
+}
+
+bool processor_t::is_waiting_for_interrupt()
+{
+  if (in_wfi && !(state.mip->read() & state.mie->read()) &&
+      halt_request == HR_NONE && !state.dcsr->halt)
+    return true;
+  in_wfi = false;
+  return false;
+}
+
+size_t processor_t::take_stalled_steps()
+{
+  size_t steps = stalled_steps;
+  stalled_steps = 0;
+  return steps;
+}
+
+// Open or close the log window before executing the instruction at pc, with
+// instret instructions retired so far in the current step.  Returns whether
+// logging was turned on or off.
+bool processor_t::update_log_window(reg_t pc, size_t instret)
+{
+  reg_t retired = log_window_retired + instret;
+
+  if (!log_window_started) {
+    if (retired < log_window.start_instret)
+      return false;
+    if (log_window.start_pc != reg_t(-1)) {
+      if (pc != log_window.start_pc)
+        return false;
+      mmu->set_iblock_break(-1);
+    }
+    log_window_started = true;
+  }
+
+  bool open = !log_window.priv_mask || ((log_window.priv_mask >> state.prv) & 1);
+  if (log_window.length) {
+    reg_t logged = log_window_logged;
+    if (log_window_open)
+      logged += retired - log_window_opened;
+    if (logged >= log_window.length) {
+      open = false;
+      log_window_armed = false;
+    }
+  }
+
+  if (open == log_window_open)
+    return false;
+  set_log_window_open(open, retired);
+  return true;
+}
+
+// Shorten a step so it ends where the log window's instruction counts say
+// it opens or closes.
+size_t processor_t::clip_to_log_window(size_t n)
+{
+  update_log_window(state.pc, 0);
+  if (!log_window_armed)
+    return n;
+
+  if (!log_window_started && log_window_retired < log_window.start_instret)
+    n = std::min<reg_t>(n, log_window.start_instret - log_window_retired);
+  if (log_window_open && log_window.length)
+    n = std::min<reg_t>(n, log_window.length - log_window_logged -
+                           (log_window_retired - log_window_opened));
+  return n;
 }
-#endif
 
 void processor_t::reset()
 {
   xlen = isa->get_max_xlen();
+  build_dispatch_table();
   state.reset(this, isa->get_max_isa());
   state.dcsr->halt = halt_on_reset;
   halt_on_reset = false;
+  in_wfi = false;
   VU.reset();
 
   if (n_pmp > 0) {
@@ -578,6 +709,110 @@ void processor_t::reset()
     sim->proc_reset(id);
 }
 
+void processor_t::save(checkpoint_writer_t& out)
+{
+  out.write_tag("HART");
+  out.write(state.pc);
+  for (size_t i = 0; i < NXPR; i++)
+    out.write(state.XPR[i]);
+  for (size_t i = 0; i < NFPR; i++)
+    out.write(state.FPR[i]);
+  out.write(state.prv);
+  out.write(state.v);
+  out.write(state.debug_mode);
+  out.write(state.serialized);
+  out.write(state.single_step);
+  out.write(halt_request);
+  out.write(mmu->load_reservation_address);
+
+  std::map<reg_t, reg_t> csrs;
+  for (auto& csr : state.csrmap)
+    if (csr.second->has_state())
+      csrs[csr.first] = csr.second->save();
+  out.write(uint64_t(csrs.size()));
+  for (auto& csr : csrs) {
+    out.write(csr.first);
+    out.write(csr.second);
+  }
+
+  out.write(uint64_t(TM.count()));
+  for (unsigned i = 0; i < TM.count(); i++) {
+    out.write(TM.tdata1_read(this, i));
+    out.write(TM.tdata2_read(this, i));
+  }
+
+  out.write(VU.vlenb);
+  out.write(VU.reg_file, NVPR * VU.vlenb);
+  out.write(VU.vlmax);
+  out.write(VU.vma);
+  out.write(VU.vta);
+  out.write(VU.vsew);
+  out.write(VU.vflmul);
+  out.write(VU.vill);
+  out.write(VU.vstart_alu);
+}
+
+void processor_t::restore(checkpoint_reader_t& in)
+{
+  in.read_tag("HART");
+  state.pc = in.read<reg_t>();
+  for (size_t i = 0; i < NXPR; i++)
+    state.XPR.write(i, in.read<reg_t>());
+  for (size_t i = 0; i < NFPR; i++)
+    state.FPR.write(i, in.read<freg_t>());
+  state.prv = in.read<reg_t>();
+  state.v = in.read<bool>();
+  state.debug_mode = in.read<bool>();
+  state.serialized = in.read<bool>();
+  state.single_step = in.read<decltype(state.single_step)>();
+  halt_request = in.read<decltype(halt_request)>();
+  mmu->load_reservation_address = in.read<reg_t>();
+
+  // Some CSRs only take values that others allow (sstateen is limited by
+  // mstateen, mstatus by misa), so write them all twice, which gives those
+  // the right values whatever the order.  PMP entries go last, since once
+  // they are locked they can't be changed.
+  std::vector<std::pair<reg_t, reg_t>> csrs, pmp;
+  for (uint64_t n = in.read<uint64_t>(); n > 0; n--) {
+    reg_t addr = in.read<reg_t>();
+    reg_t val = in.read<reg_t>();
+    auto search = state.csrmap.find(addr);
+    if (search == state.csrmap.end() || !search->second->has_state())
+      throw std::runtime_error("checkpoint has a CSR this hart lacks");
+    bool last = (addr >= CSR_PMPCFG0 && addr <= CSR_PMPCFG15) || addr == CSR_MSECCFG;
+    (last ? pmp : csrs).push_back(std::make_pair(addr, val));
+  }
+  for (int pass = 0; pass < 2; pass++) {
+    for (auto& csr : csrs)
+      state.csrmap[csr.first]->restore(csr.second);
+  }
+  for (auto& csr : pmp)
+    state.csrmap[csr.first]->restore(csr.second);
+
+  if (in.read<uint64_t>() != TM.count())
+    throw std::runtime_error("checkpoint has a different number of triggers");
+  for (unsigned i = 0; i < TM.count(); i++) {
+    reg_t tdata1 = in.read<reg_t>();
+    TM.tdata2_write(this, i, in.read<reg_t>());
+    TM.tdata1_write(this, i, tdata1);
+  }
+
+  if (in.read<reg_t>() != VU.vlenb)
+    throw std::runtime_error("checkpoint has a different VLEN");
+  in.read(VU.reg_file, NVPR * VU.vlenb);
+  VU.vlmax = in.read<reg_t>();
+  VU.vma = in.read<reg_t>();
+  VU.vta = in.read<reg_t>();
+  VU.vsew = in.read<reg_t>();
+  VU.vflmul = in.read<float>();
+  VU.vill = in.read<bool>();
+  VU.vstart_alu = in.read<bool>();
+
+  build_dispatch_table();
+  mmu->flush_tlb();
+  mmu->flush_icache();
+}
+
 extension_t* processor_t::get_extension()
 {
   switch (custom_extensions.size()) {
@@ -751,7 +986,10 @@ void processor_t::enter_debug_mode(uint8_t cause)
 
 void processor_t::debug_output_log(std::stringstream *s)
 {
-  if (log_file == stderr) {
+  if (log_writer) {
+    std::string str = s->str();
+    log_writer->write(str.data(), str.size());
+  } else if (log_file == stderr) {
     std::ostream out(sout_.rdbuf());
     out << s->str(); // handles command line options -d -s -l
   } else {
@@ -863,31 +1101,14 @@ void processor_t::disasm(insn_t insn)
 {
   uint64_t bits = insn.bits();
   if (last_pc != state.pc || last_bits != bits) {
-    std::stringstream s;  // first put everything in a string, later send it to output
-
-#ifdef RISCV_ENABLE_COMMITLOG
-    const char* sym = get_symbol(state.pc);
-    if (sym != nullptr)
-    {
-      s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
-        << ": >>>>  " << sym << std::endl;
-    }
-#endif
-
-    if (executions != 1) {
-      s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
-        << ": Executed " << executions << " times" << std::endl;
+    if (log_writer) {
+      log_writer->trace(this, state.pc, bits, executions);
+    } else {
+      std::stringstream s;  // first put everything in a string, later send it to output
+      print_trace(s, state.pc, insn, executions);
+      debug_output_log(&s);
     }
 
-    unsigned max_xlen = isa->get_max_xlen();
-
-    s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
-      << std::hex << ": 0x" << std::setfill('0') << std::setw(max_xlen / 4)
-      << zext(state.pc, max_xlen) << " (0x" << std::setw(8) << bits << ") "
-      << disassembler->disassemble(insn) << std::endl;
-
-    debug_output_log(&s);
-
     last_pc = state.pc;
     last_bits = bits;
     executions = 1;
@@ -896,6 +1117,28 @@ void processor_t::disasm(insn_t insn)
   }
 }
 
+void processor_t::print_trace(std::ostream& s, reg_t pc, insn_t insn, uint64_t executions)
+{
+  const char* sym = get_symbol(pc);
+  if (sym != nullptr)
+  {
+    s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
+      << ": >>>>  " << sym << std::endl;
+  }
+
+  if (executions != 1) {
+    s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
+      << ": Executed " << executions << " times" << std::endl;
+  }
+
+  unsigned max_xlen = isa->get_max_xlen();
+
+  s << "core " << std::dec << std::setfill(' ') << std::setw(3) << id
+    << std::hex << ": 0x" << std::setfill('0') << std::setw(max_xlen / 4)
+    << zext(pc, max_xlen) << " (0x" << std::setw(8) << insn.bits() << ") "
+    << disassembler->disassemble(insn) << std::endl;
+}
+
 int processor_t::paddr_bits()
 {
   unsigned max_xlen = isa->get_max_xlen();
@@ -934,42 +1177,47 @@ reg_t illegal_instruction(processor_t* p, insn_t insn, reg_t pc)
   throw trap_illegal_instruction(insn.bits());
 }
 
-insn_func_t processor_t::decode_insn(insn_t insn)
+// Index of the first-level decode bucket: the quadrant and funct3 of a
+// compressed instruction, or the major opcode and funct3 of a longer one.
+static inline size_t decode_bucket(insn_bits_t bits)
 {
-  // look up opcode in hash table
-  size_t idx = insn.bits() % OPCODE_CACHE_SIZE;
-  insn_desc_t desc = opcode_cache[idx];
-
-  bool rve = extension_enabled('E');
-
-  if (unlikely(insn.bits() != desc.match)) {
-    // fall back to linear search
-    int cnt = 0;
-    insn_desc_t* p = &instructions[0];
-    while ((insn.bits() & p->mask) != p->match)
-      p++, cnt++;
-    desc = *p;
-
-    if (p->mask != 0 && p > &instructions[0]) {
-      if (p->match != (p - 1)->match && p->match != (p + 1)->match) {
-        // move to front of opcode list to reduce miss penalty
-        while (--p >= &instructions[0])
-          *(p + 1) = *p;
-        instructions[0] = desc;
-      }
-    }
+  if ((bits & 0x3) != 0x3)
+    return (bits & 0x3) | ((bits >> 11) & 0x1c);
+  return 32 + (((bits >> 2) & 0x1f) | ((bits >> 7) & 0xe0));
+}
 
-    opcode_cache[idx] = desc;
-    opcode_cache[idx].match = insn.bits();
+insn_func_t processor_t::decode_insn(insn_t insn)
+{
+  insn_bits_t bits = insn.bits();
+  const decode_bucket_t& bucket = decode_buckets[decode_bucket(bits)];
+  size_t leaf = bucket.leaf + (bucket.split ? (bits >> 25) & 0x7f : 0);
+  const dispatch_entry_t* p = &dispatch_table[decode_leaves[leaf]];
+
+  // every leaf ends with a catch-all, so the search terminates
+  if (unlikely((bits & p->mask) != p->match)) {
+    decode_misses++;
+    do
+      p++;
+    while ((bits & p->mask) != p->match);
   }
 
-  return desc.func(xlen, rve);
+  return p->func;
 }
 
 void processor_t::register_insn(insn_desc_t desc)
 {
   assert(desc.rv32i && desc.rv64i && desc.rv32e && desc.rv64e);
 
+  // custom instructions needn't provide commit-logging variants
+  if (!desc.logged_rv32i)
+    desc.logged_rv32i = desc.rv32i;
+  if (!desc.logged_rv64i)
+    desc.logged_rv64i = desc.rv64i;
+  if (!desc.logged_rv32e)
+    desc.logged_rv32e = desc.rv32e;
+  if (!desc.logged_rv64e)
+    desc.logged_rv64e = desc.rv64e;
+
   instructions.push_back(desc);
 }
 
@@ -984,8 +1232,54 @@ void processor_t::build_opcode_map()
   };
   std::sort(instructions.begin(), instructions.end(), cmp());
 
-  for (size_t i = 0; i < OPCODE_CACHE_SIZE; i++)
-    opcode_cache[i] = insn_desc_t::illegal();
+  decode_list.clear();
+  decode_leaves.clear();
+
+  // Append a leaf holding, in priority order, every instruction that can
+  // match an encoding whose bits under key_mask equal key_match.
+  auto add_leaf = [&](insn_bits_t key_mask, insn_bits_t key_match) {
+    decode_leaves.push_back(decode_list.size());
+    for (auto& desc : instructions)
+      if (((desc.match ^ key_match) & desc.mask & key_mask) == 0)
+        decode_list.push_back(desc);
+  };
+
+  for (size_t i = 0; i < DECODE_BUCKETS; i++) {
+    insn_bits_t key_mask, key_match;
+    if (i < 32) {
+      key_mask = 0xe003;
+      key_match = (i & 0x3) | ((i >> 2) << 13);
+    } else {
+      key_mask = 0x707f;
+      key_match = 0x3 | (((i - 32) & 0x1f) << 2) | (((i - 32) >> 5) << 12);
+    }
+
+    decode_buckets[i].leaf = decode_leaves.size();
+    decode_buckets[i].split = false;
+    add_leaf(key_mask, key_match);
+
+    // split crowded buckets on funct7
+    if (i >= 32 && decode_list.size() - decode_leaves.back() > DECODE_SPLIT_THRESHOLD) {
+      decode_list.resize(decode_leaves.back());
+      decode_leaves.pop_back();
+      decode_buckets[i].split = true;
+      for (insn_bits_t funct7 = 0; funct7 < 128; funct7++)
+        add_leaf(key_mask | 0xfe000000, key_match | (funct7 << 25));
+    }
+  }
+
+  build_dispatch_table();
+}
+
+void processor_t::build_dispatch_table()
+{
+  // E can't be toggled through misa, so the ISA string decides it
+  bool rve = isa->extension_enabled('E');
+
+  dispatch_table.resize(decode_list.size());
+  for (size_t i = 0; i < decode_list.size(); i++)
+    dispatch_table[i] = {decode_list[i].match, decode_list[i].mask,
+                         decode_list[i].func(xlen, rve, log_commits_enabled)};
 }
 
 void processor_t::register_extension(extension_t* x)
@@ -1022,6 +1316,10 @@ void processor_t::register_base_instructions()
     extern reg_t rv64i_##name(processor_t*, insn_t, reg_t); \
     extern reg_t rv32e_##name(processor_t*, insn_t, reg_t); \
     extern reg_t rv64e_##name(processor_t*, insn_t, reg_t); \
+    extern reg_t logged_rv32i_##name(processor_t*, insn_t, reg_t); \
+    extern reg_t logged_rv64i_##name(processor_t*, insn_t, reg_t); \
+    extern reg_t logged_rv32e_##name(processor_t*, insn_t, reg_t); \
+    extern reg_t logged_rv64e_##name(processor_t*, insn_t, reg_t); \
     if (name##_supported) { \
       register_insn((insn_desc_t) { \
         name##_match, \
@@ -1029,7 +1327,11 @@ void processor_t::register_base_instructions()
         rv32i_##name, \
         rv64i_##name, \
         rv32e_##name, \
-        rv64e_##name}); \
+        rv64e_##name, \
+        logged_rv32i_##name, \
+        logged_rv64i_##name, \
+        logged_rv32e_##name, \
+        logged_rv64e_##name}); \
     }
   #include "insn_list.h"
   #undef DEFINE_INSN
@@ -19,6 +19,13 @@
 
 class processor_t;
 class mmu_t;
+class jit_t;
+class binary_commit_log_t;
+class log_writer_t;
+class checkpoint_writer_t;
+class checkpoint_reader_t;
+class bbv_profile_t;
+struct iblock_t;
 typedef reg_t (*insn_func_t)(processor_t*, insn_t, reg_t);
 class simif_t;
 class trap_t;
@@ -35,9 +42,20 @@ struct insn_desc_t
   insn_func_t rv64i;
   insn_func_t rv32e;
   insn_func_t rv64e;
+  // variants that record register writes for the commit log
+  insn_func_t logged_rv32i;
+  insn_func_t logged_rv64i;
+  insn_func_t logged_rv32e;
+  insn_func_t logged_rv64e;
 
-  insn_func_t func(int xlen, bool rve)
+  insn_func_t func(int xlen, bool rve, bool logged)
   {
+    if (logged) {
+      if (rve)
+        return xlen == 64 ? logged_rv64e : logged_rv32e;
+      else
+        return xlen == 64 ? logged_rv64i : logged_rv32i;
+    }
     if (rve)
       return xlen == 64 ? rv64e : rv32e;
     else
@@ -46,15 +64,81 @@ struct insn_desc_t
 
   static insn_desc_t illegal()
   {
-    return {0, 0, &illegal_instruction, &illegal_instruction, &illegal_instruction, &illegal_instruction};
+    return {0, 0, &illegal_instruction, &illegal_instruction, &illegal_instruction, &illegal_instruction,
+            &illegal_instruction, &illegal_instruction, &illegal_instruction, &illegal_instruction};
   }
 };
 
-// regnum, data
-typedef std::unordered_map<reg_t, freg_t> commit_log_reg_t;
+// A list of commit-log records, cleared after every instruction.  The first
+// N records are kept inline; only vector instructions produce more than that,
+// and the excess spills to the heap.
+template <class T, size_t N>
+class commit_log_buf_t
+{
+public:
+  commit_log_buf_t() : n(0) {}
+
+  size_t size() const { return n; }
+  bool empty() const { return n == 0; }
+
+  void clear()
+  {
+    if (unlikely(n > N))
+      spill.clear();
+    n = 0;
+  }
+
+  T& at(size_t i) { return i < N ? recs[i] : spill[i - N]; }
+  const T& at(size_t i) const { return i < N ? recs[i] : spill[i - N]; }
+
+  void push_back(const T& rec)
+  {
+    if (likely(n < N))
+      recs[n] = rec;
+    else
+      spill.push_back(rec);
+    n++;
+  }
+
+  class const_iterator
+  {
+  public:
+    const_iterator(const commit_log_buf_t* buf, size_t i) : buf(buf), i(i) {}
+    const T& operator*() const { return buf->at(i); }
+    const_iterator& operator++() { i++; return *this; }
+    bool operator!=(const const_iterator& other) const { return i != other.i; }
+
+  private:
+    const commit_log_buf_t* buf;
+    size_t i;
+  };
+
+  const_iterator begin() const { return const_iterator(this, 0); }
+  const_iterator end() const { return const_iterator(this, n); }
+
+private:
+  size_t n;
+  T recs[N];
+  std::vector<T> spill;
+};
+
+// regnum, data; records are kept in the order the registers were first written
+class commit_log_reg_t : public commit_log_buf_t<std::pair<reg_t, freg_t>, 4>
+{
+public:
+  // Find the record for a register, adding one if this is its first write
+  freg_t& operator[](reg_t key)
+  {
+    for (size_t i = 0; i < size(); i++)
+      if (at(i).first == key)
+        return at(i).second;
+    push_back(std::make_pair(key, freg_t()));
+    return at(size() - 1).second;
+  }
+};
 
 // addr, value, size
-typedef std::vector<std::tuple<reg_t, uint64_t, uint8_t>> commit_log_mem_t;
+typedef commit_log_buf_t<std::tuple<reg_t, uint64_t, uint8_t>, 4> commit_log_mem_t;
 
 enum VRM{
   RNU = 0,
@@ -204,14 +288,22 @@ struct state_t
       STEP_STEPPED
   } single_step;
 
-#ifdef RISCV_ENABLE_COMMITLOG
   commit_log_reg_t log_reg_write;
   commit_log_mem_t log_mem_read;
   commit_log_mem_t log_mem_write;
   reg_t last_inst_priv;
   int last_inst_xlen;
   int last_inst_flen;
-#endif
+};
+
+// When a hart logs (--log-start-instret and friends).  Outside the window
+// the hart runs on the fast path with logging off.
+struct log_window_t
+{
+  reg_t start_instret = 0; // open once this many instructions have retired
+  reg_t start_pc = -1;     // ... and this PC has been reached, if not -1
+  reg_t priv_mask = 0;     // log only in modes with bit 1 << prv set, if not 0
+  reg_t length = 0;        // stop for good after this many, if not 0
 };
 
 typedef enum {
@@ -242,12 +334,36 @@ public:
 
   void set_debug(bool value);
   void set_histogram(bool value);
-#ifdef RISCV_ENABLE_COMMITLOG
-  void enable_log_commits();
+  void set_jit(bool value);
+  // Log the results of every instruction, in binary form if bin is given
+  void enable_log_commits(binary_commit_log_t* bin = NULL);
   bool get_log_commits_enabled() const { return log_commits_enabled; }
-#endif
+  binary_commit_log_t* get_binary_commit_log() { return commit_log_bin; }
+  // Send the -l trace and debug messages through writer, if not NULL
+  void set_log_writer(log_writer_t* writer) { log_writer = writer; }
+  // Confine the logging enabled so far to a window.  A later window
+  // replaces it, and logs the same things.
+  void set_log_window(const log_window_t& window);
+  // Count the instructions executed in each basic block into profile, if
+  // not NULL.  Only the fast path counts, so the profile is meant for runs
+  // without -d, -l, -g or --log-commits.
+  void set_bbv_profile(bbv_profile_t* profile);
+  // Write the -l trace and --log-commits log to file instead
+  void set_log_file(FILE* file) { log_file = file; }
+  // Draw the seed CSR's entropy from a generator seeded with seed
+  void set_entropy_seed(uint64_t seed) { es.set_prng_seed(seed); }
+  // The instructions left of the last step, if it stalled in the parallel
+  // phase of deterministic mode (see page_owners_t), or 0.  Clears them.
+  size_t take_stalled_steps();
+  // Is the hart stopped in WFI, with nothing yet to wake it?  The simulation
+  // doesn't step it until an interrupt enabled in mie is pending, or the
+  // debugger asks it to halt.
+  bool is_waiting_for_interrupt();
   void reset();
   void step(size_t n); // run for n cycles
+  // Write this hart's architectural state to a checkpoint, or read it back
+  void save(checkpoint_writer_t& out);
+  void restore(checkpoint_reader_t& in);
   void put_csr(int which, reg_t val);
   uint32_t get_id() const { return id; }
   reg_t get_csr(int which, insn_t insn, bool write, bool peek = 0);
@@ -268,6 +384,7 @@ public:
   }
   extension_t* get_extension();
   extension_t* get_extension(const char* name);
+  uint64_t get_decode_misses() const { return decode_misses; }
   bool any_custom_extensions() const {
     return !custom_extensions.empty();
   }
@@ -331,11 +448,16 @@ public:
 
   const char* get_symbol(uint64_t addr);
 
+  // Print one line of the -l trace, preceded by the symbol at pc, if any,
+  // and by how many times the previous line's instruction was executed
+  void print_trace(std::ostream& s, reg_t pc, insn_t insn, uint64_t executions);
+
 private:
   const isa_parser_t * const isa;
 
   simif_t* sim;
   mmu_t* mmu; // main memory is always accessed via the mmu
+  jit_t* jit; // translates hot blocks to host code, if enabled
   std::unordered_map<std::string, extension_t*> custom_extensions;
   disassembler_t* disassembler;
   state_t state;
@@ -343,7 +465,35 @@ private:
   unsigned xlen;
   bool histogram_enabled;
   bool log_commits_enabled;
+  binary_commit_log_t* commit_log_bin;
+  log_writer_t* log_writer;
   FILE *log_file;
+
+  log_window_t log_window;
+  bool log_window_armed;   // a window is set and hasn't ended
+  bool log_window_started; // its start conditions have been met
+  bool log_window_open;
+  bool log_window_trace;   // -l, inside the window
+  bool log_window_commits; // --log-commits, inside the window
+  reg_t log_window_retired; // instructions retired, as of the current step
+  reg_t log_window_logged;  // ... and logged before the window last opened
+  reg_t log_window_opened;  // retired count when the window last opened
+  bool update_log_window(reg_t pc, size_t instret);
+  void set_log_window_open(bool open, reg_t retired);
+  size_t clip_to_log_window(size_t n);
+
+  bbv_profile_t* bbv;
+  uint32_t bbv_block;       // the basic block being executed
+  size_t bbv_block_entered; // instret, in the current step, when it was entered
+  reg_t bbv_resume_pc;      // where bbv_block carries on, if it hasn't ended
+  reg_t bbv_retired;        // instructions retired in the current interval
+  void bbv_enter_block(iblock_t* block, reg_t pc, size_t instret);
+  void bbv_end_step(size_t instret);
+
+  size_t stalled_steps;
+  bool in_wfi;
+  bool stall_traced; // the stalled instruction is already in the -l trace
+
   std::ostream sout_; // needed for socket command interface -s, also used for -d and -l, but not for --log
   bool halt_on_reset;
   std::vector<bool> impl_table;
@@ -351,8 +501,29 @@ private:
   std::vector<insn_desc_t> instructions;
   std::map<reg_t,uint64_t> pc_histogram;
 
-  static const size_t OPCODE_CACHE_SIZE = 8191;
-  insn_desc_t opcode_cache[OPCODE_CACHE_SIZE];
+  // Two-level instruction decoder.  The first level is indexed by the
+  // quadrant and funct3 of compressed instructions, or the major opcode and
+  // funct3 of longer ones; crowded buckets are split again on funct7.  Each
+  // leaf is a run of decode_list, in priority order, ending in a catch-all.
+  static const size_t DECODE_BUCKETS = 32 + 256;
+  static const size_t DECODE_SPLIT_THRESHOLD = 8;
+  struct decode_bucket_t {
+    bool split;  // indexed further by funct7
+    size_t leaf; // index into decode_leaves
+  };
+  decode_bucket_t decode_buckets[DECODE_BUCKETS];
+  std::vector<size_t> decode_leaves; // start of each leaf in decode_list
+  std::vector<insn_desc_t> decode_list;
+  uint64_t decode_misses;
+
+  // decode_list specialized for the current xlen, E, and commit logging, so
+  // a lookup yields the handler directly.  Rebuilt whenever any changes.
+  struct dispatch_entry_t {
+    insn_bits_t match;
+    insn_bits_t mask;
+    insn_func_t func;
+  };
+  std::vector<dispatch_entry_t> dispatch_table; // lookups not satisfied by a leaf's first entry
 
   void take_pending_interrupt() { take_interrupt(state.mip->read() & state.mie->read()); }
   void take_interrupt(reg_t mask); // take first enabled interrupt in mask
@@ -365,12 +536,14 @@ private:
   void debug_output_log(std::stringstream *s); // either output to interactive user or write to log file
 
   friend class mmu_t;
+  friend class jit_t;
   friend class clint_t;
   friend class extension_t;
 
   void parse_varch_string(const char*);
   void parse_priv_string(const char*);
   void build_opcode_map();
+  void build_dispatch_table();
   void register_base_instructions();
   insn_func_t decode_insn(insn_t insn);
 
@@ -415,10 +588,8 @@ public:
 #endif
           reg_referenced[vReg] = 1;
 
-#ifdef RISCV_ENABLE_COMMITLOG
-          if (is_write)
+          if (is_write && p->get_log_commits_enabled())
             p->get_state()->log_reg_write[((vReg) << 4) | 2] = {0, 0};
-#endif
 
           T *regStart = (T*)((char*)reg_file + vReg * (VLEN >> 3));
           return regStart[n];
@@ -2,6 +2,7 @@
 
 #include "sim.h"
 #include "mmu.h"
+#include "checkpoint.h"
 #include "dts.h"
 #include "remote_bitbang.h"
 #include "byteorder.h"
@@ -12,10 +13,16 @@
 #include <iostream>
 #include <sstream>
 #include <climits>
+#include <algorithm>
+#include <stdexcept>
 #include <cstdlib>
+#include <cstring>
+#include <cerrno>
 #include <cassert>
 #include <signal.h>
 #include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
 #include <sys/wait.h>
 #include <sys/types.h>
 
@@ -47,7 +54,18 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
     procs(std::max(cfg->nprocs(), size_t(1))),
     dtb_file(dtb_file ? dtb_file : ""),
     dtb_enabled(dtb_enabled),
+    log_path(log_path ? log_path : ""),
     log_file(log_path),
+    log_window_enabled(false),
+    checkpoint_save_instret(0),
+    sampling(false),
+    samples_taken(0),
+    next_sample(0),
+    in_sample(false),
+    sample_end(0),
+    rounds_started(0),
+    groups_running(0),
+    hart_threads_stopping(false),
     cmd_file(cmd_file),
 #ifdef HAVE_BOOST_ASIO
     io_service_ptr(io_service_ptr), // socket interface
@@ -59,6 +77,7 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
     debug(false),
     histogram_enabled(false),
     log(false),
+    log_commits(false),
     remote_bitbang(NULL),
     debug_module(this, dm_config)
 {
@@ -171,6 +190,23 @@ sim_t::sim_t(const cfg_t *cfg, bool halted,
 
 sim_t::~sim_t()
 {
+  {
+    std::lock_guard<std::mutex> guard(round_lock);
+    hart_threads_stopping = true;
+  }
+  round_start.notify_all();
+  for (auto& thread : hart_threads)
+    thread.join();
+
+  for (auto& log : hart_logs) {
+    fclose(log.file);
+    free(log.buf);
+  }
+
+  // the log writer may still be printing the harts' trace records
+  commit_log_bin.reset();
+  log_writer.reset();
+
   for (size_t i = 0; i < procs.size(); i++)
     delete procs[i];
   delete debug_mmu;
@@ -183,13 +219,45 @@ void sim_thread_main(void* arg)
 
 void sim_t::main()
 {
+  if (!checkpoint_restore_path.empty()) {
+    try {
+      restore_checkpoint(checkpoint_restore_path);
+    } catch (std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+  }
+
   if (!debug && log)
     set_procs_debug(true);
 
+  if (!debug && log_window_enabled) {
+    if (!log_window_symbol.empty() &&
+        !find_symbol(log_window_symbol.c_str(), &log_window.start_pc)) {
+      fprintf(stderr, "Symbol %s not found\n", log_window_symbol.c_str());
+      exit(1);
+    }
+    for (processor_t *proc : procs)
+      proc->set_log_window(log_window);
+  }
+
+  if (page_owners && (log || log_commits))
+    open_hart_logs();
+
+  // the parent of the samples doesn't log, until a sample starts
+  if (sampling && (log || log_commits)) {
+    log_window_t never;
+    never.start_instret = -1;
+    for (processor_t *proc : procs)
+      proc->set_log_window(never);
+  }
+
   while (!done())
   {
     if (debug || ctrlc_pressed)
       interactive();
+    else if (!hart_threads.empty() || page_owners)
+      step_concurrently();
     else
       step(INTERLEAVE);
     if (remote_bitbang) {
@@ -202,7 +270,9 @@ int sim_t::run()
 {
   host = context_t::current();
   target.init(sim_thread_main, this);
-  return htif_t::run();
+  int code = htif_t::run();
+  wait_for_samples(0);
+  return code;
 }
 
 void sim_t::step(size_t n)
@@ -210,7 +280,22 @@ void sim_t::step(size_t n)
   for (size_t i = 0, steps = 0; i < n; i += steps)
   {
     steps = std::min(n - i, INTERLEAVE - current_step);
-    procs[current_proc]->step(steps);
+
+    if (current_proc == 0) {
+      reg_t event = next_instret_event();
+      if (unlikely(event != reg_t(-1))) {
+        reg_t retired = procs[0]->get_state()->minstret->read();
+        if (!handle_instret_events(retired)) {
+          set_exit_code(0);
+          host->switch_to();
+          return;
+        }
+        steps = std::min<reg_t>(steps, next_instret_event() - retired);
+      }
+    }
+
+    if (!procs[current_proc]->is_waiting_for_interrupt())
+      procs[current_proc]->step(steps);
 
     current_step += steps;
     if (current_step == INTERLEAVE)
@@ -227,6 +312,128 @@ void sim_t::step(size_t n)
   }
 }
 
+void sim_t::step_concurrently()
+{
+  if (page_owners)
+    page_owners->set_parallel(true);
+
+  groups_running = hart_threads.size();
+  {
+    std::lock_guard<std::mutex> guard(round_lock);
+    rounds_started++;
+  }
+  round_start.notify_all();
+
+  step_hart_group(0);
+  while (groups_running.load() != 0)
+    std::this_thread::yield();
+
+  if (page_owners)
+    finish_round_serially();
+
+  if (clint) clint->increment(INTERLEAVE / INSNS_PER_RTC_TICK);
+  host->switch_to();
+}
+
+void sim_t::step_hart_group(size_t group)
+{
+  for (size_t i = group; i < procs.size(); i += hart_threads.size() + 1) {
+    if (!procs[i]->is_waiting_for_interrupt())
+      procs[i]->step(INTERLEAVE);
+    procs[i]->get_mmu()->yield_load_reservation();
+  }
+}
+
+void sim_t::finish_round_serially()
+{
+  page_owners->set_parallel(false);
+  for (size_t i = 0; i < procs.size(); i++)
+    flush_hart_log(i);
+
+  for (size_t i = 0; i < procs.size(); i++) {
+    if (size_t steps = procs[i]->take_stalled_steps()) {
+      procs[i]->step(steps);
+      procs[i]->get_mmu()->yield_load_reservation();
+      flush_hart_log(i);
+    }
+  }
+
+  for (size_t i = 0; i < procs.size(); i++) {
+    if (page_owners->take_revoked(i))
+      procs[i]->get_mmu()->flush_tlb_entries();
+  }
+}
+
+void sim_t::open_hart_logs()
+{
+  // the buffers' addresses are given out, so mustn't move
+  hart_logs.resize(procs.size());
+  for (size_t i = 0; i < procs.size(); i++) {
+    hart_log_t& log = hart_logs[i];
+    log.file = open_memstream(&log.buf, &log.size);
+    if (!log.file) {
+      perror("open_memstream");
+      exit(1);
+    }
+    procs[i]->set_log_file(log.file);
+  }
+}
+
+void sim_t::flush_hart_log(size_t i)
+{
+  if (hart_logs.empty())
+    return;
+
+  hart_log_t& log = hart_logs[i];
+  fflush(log.file);
+  fwrite(log.buf, 1, log.size, log_file.get());
+  rewind(log.file);
+}
+
+void sim_t::hart_thread_main(size_t group)
+{
+  // A quantum is short, so spin for a while before sleeping
+  static const int SPIN_LIMIT = 1000;
+
+  for (size_t round = 0; ; round++) {
+    for (int i = 0; i < SPIN_LIMIT && rounds_started.load() == round; i++)
+      std::this_thread::yield();
+    {
+      std::unique_lock<std::mutex> guard(round_lock);
+      round_start.wait(guard, [&]{ return rounds_started.load() != round || hart_threads_stopping; });
+      if (hart_threads_stopping)
+        return;
+    }
+
+    step_hart_group(group);
+    groups_running--;
+  }
+}
+
+void sim_t::set_hart_threads(size_t n)
+{
+  n = std::min(n, procs.size());
+  if (n <= 1)
+    return;
+
+  // In deterministic mode, only one hart may write a page at a time anyway
+  if (!page_owners) {
+    for (processor_t* proc : procs)
+      proc->get_mmu()->set_concurrent(true);
+  }
+  for (size_t group = 1; group < n; group++)
+    hart_threads.emplace_back(&sim_t::hart_thread_main, this, group);
+}
+
+void sim_t::set_deterministic(uint64_t seed)
+{
+  page_owners.reset(new page_owners_t(procs.size()));
+  for (size_t i = 0; i < procs.size(); i++) {
+    procs[i]->get_mmu()->set_page_owners(page_owners.get(), i);
+    procs[i]->set_entropy_seed(seed + i);
+  }
+}
+
 void sim_t::set_debug(bool value)
 {
   debug = value;
@@ -240,24 +447,305 @@ void sim_t::set_histogram(bool value)
   }
 }
 
-void sim_t::configure_log(bool enable_log, bool enable_commitlog)
+void sim_t::set_jit(bool value)
+{
+  for (size_t i = 0; i < procs.size(); i++) {
+    procs[i]->set_jit(value);
+  }
+}
+
+void sim_t::configure_log(bool enable_log, bool enable_commitlog,
+                          bool commitlog_binary, bool async)
 {
   log = enable_log;
+  log_commits = enable_commitlog;
+
+  if (async || (enable_commitlog && commitlog_binary))
+    log_writer.reset(new log_writer_t(log_file.get(), async));
+
+  // An asynchronous text commit log is also encoded in binary, so that the
+  // writer thread does the formatting.
+  if (enable_commitlog && (commitlog_binary || async))
+    commit_log_bin.reset(new binary_commit_log_t(log_writer.get(), !commitlog_binary));
 
-  if (!enable_commitlog)
+  for (processor_t *proc : procs) {
+    if (async)
+      proc->set_log_writer(log_writer.get());
+    if (enable_commitlog)
+      proc->enable_log_commits(commit_log_bin.get());
+  }
+}
+
+void sim_t::set_log_window(const log_window_t& window, const char* start_symbol)
+{
+  log_window_enabled = true;
+  log_window = window;
+  log_window_symbol = start_symbol ? start_symbol : "";
+}
+
+void sim_t::set_checkpoint_save(const char* path, reg_t instret)
+{
+  checkpoint_save_path = path;
+  checkpoint_save_instret = instret;
+}
+
+void sim_t::set_checkpoint_restore(const char* path)
+{
+  checkpoint_restore_path = path;
+}
+
+void sim_t::configure_sampling(const sample_config_t& config)
+{
+  sampling = true;
+  sample = config;
+  next_sample = config.points.empty() ? config.start : config.points[0];
+}
+
+void sim_t::add_sample_memtracer(memtracer_t* tracer)
+{
+  sample_tracers.push_back(tracer);
+}
+
+void sim_t::configure_bbv(const char* path, reg_t interval)
+{
+  for (size_t i = 0; i < procs.size(); i++) {
+    std::string name = path;
+    if (procs.size() > 1)
+      name += "." + std::to_string(i);
+    try {
+      bbv_profiles.emplace_back(new bbv_profile_t(name.c_str(), interval));
+    } catch (std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+    procs[i]->set_bbv_profile(bbv_profiles.back().get());
+  }
+}
+
+reg_t sim_t::next_instret_event()
+{
+  reg_t event = -1;
+  if (!checkpoint_save_path.empty())
+    event = std::min(event, checkpoint_save_instret);
+  if (in_sample)
+    event = std::min(event, sample_end);
+  else if (sampling)
+    event = std::min(event, next_sample);
+  return event;
+}
+
+bool sim_t::handle_instret_events(reg_t retired)
+{
+  if (!checkpoint_save_path.empty() && retired >= checkpoint_save_instret) {
+    try {
+      save_checkpoint(checkpoint_save_path);
+    } catch (std::runtime_error& e) {
+      std::cerr << e.what() << std::endl;
+      exit(1);
+    }
+    checkpoint_save_path.clear();
+    return false;
+  }
+
+  if (in_sample)
+    return retired < sample_end;
+
+  if (sampling && retired >= next_sample) {
+    start_sample(retired);
+    if (!in_sample && ((sample.count && samples_taken == sample.count) ||
+                       next_sample == reg_t(-1)))
+      return false;
+  }
+  return true;
+}
+
+void sim_t::start_sample(reg_t retired)
+{
+  size_t k = samples_taken++;
+  if (sample.points.empty()) {
+    while (next_sample <= retired)
+      next_sample += sample.interval;
+  } else {
+    k = next_sample / sample.interval;
+    auto next = std::upper_bound(sample.points.begin(), sample.points.end(), retired);
+    next_sample = next == sample.points.end() ? reg_t(-1) : *next;
+  }
+
+  wait_for_samples(sample.jobs - 1);
+
+  // don't let the child write out what the parent has buffered, or the
+  // other way round, and note where the target's files are before the
+  // parent moves on
+  fflush(NULL);
+  auto fds = target_fds().save();
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    fprintf(stderr, "can't fork sample %zu: %s\n", k, strerror(errno));
+    return;
+  }
+  if (pid > 0) {
+    sample_children[pid] = k;
     return;
+  }
 
-#ifndef RISCV_ENABLE_COMMITLOG
-  fputs("Commit logging support has not been properly enabled; "
-        "please re-build the riscv-isa-sim project using "
-        "\"configure --enable-commitlog\".\n",
-        stderr);
-  abort();
-#else
+  in_sample = true;
+  sample_end = retired + sample.length;
+  sample_children.clear();
+  checkpoint_save_path.clear();
+
+  redirect_sample_output(k, fds);
+
+  log_window_t window;
+  window.length = sample.length;
   for (processor_t *proc : procs) {
-    proc->enable_log_commits();
+    for (memtracer_t *tracer : sample_tracers)
+      proc->get_mmu()->register_memtracer(tracer);
+    proc->get_mmu()->flush_icache();
+    if (log || log_commits)
+      proc->set_log_window(window);
   }
-#endif
+}
+
+void sim_t::redirect_sample_output(size_t k, const std::vector<fds_t::saved_fd_t>& fds)
+{
+  target_fds().unshare(fds);
+
+  std::string path = sample.output + "." + std::to_string(k) + ".out";
+  int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd < 0) {
+    fprintf(stderr, "can't create %s: %s\n", path.c_str(), strerror(errno));
+    exit(1);
+  }
+
+  // The target's stdout and stderr are copies of ours, unless it has
+  // replaced them with files of its own.
+  struct stat console, st;
+  if (fstat(1, &console) == 0) {
+    for (reg_t target_fd : {1, 2}) {
+      int host_fd = target_fds().lookup(target_fd);
+      if (host_fd >= 0 && fstat(host_fd, &st) == 0 &&
+          st.st_dev == console.st_dev && st.st_ino == console.st_ino)
+        dup2(fd, host_fd);
+    }
+  }
+  dup2(fd, 1);
+  dup2(fd, 2);
+  close(fd);
+
+  if (!log_path.empty()) {
+    path = log_path + "." + std::to_string(k);
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+    if (fd < 0) {
+      fprintf(stderr, "can't create %s: %s\n", path.c_str(), strerror(errno));
+      exit(1);
+    }
+    dup2(fd, fileno(log_file.get()));
+    close(fd);
+  }
+  if (commit_log_bin)
+    commit_log_bin->restart();
+}
+
+void sim_t::wait_for_samples(size_t max_running)
+{
+  while (sample_children.size() > max_running) {
+    int status;
+    pid_t pid = waitpid(-1, &status, 0);
+    if (pid < 0) {
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    auto it = sample_children.find(pid);
+    if (it == sample_children.end())
+      continue;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+      fprintf(stderr, "sample %zu failed\n", it->second);
+    sample_children.erase(it);
+  }
+}
+
+void sim_t::save_checkpoint(const std::string& path)
+{
+  checkpoint_writer_t out(path.c_str());
+
+  out.write_tag("CONF");
+  out.write_string(cfg->isa());
+  out.write_string(cfg->priv());
+  out.write(uint64_t(procs.size()));
+  out.write(uint64_t(mems.size()));
+  for (auto& mem : mems) {
+    out.write(mem.first);
+    out.write(mem.second->size());
+  }
+
+  out.write_tag("SIM ");
+  out.write(current_step);
+  out.write(current_proc);
+  for (auto& fd : target_fds().save()) {
+    out.write(true);
+    out.write_string(fd.path);
+    out.write(fd.flags);
+    out.write(fd.offset);
+  }
+  out.write(false);
+
+  for (auto& mem : mems)
+    mem.second->save(out);
+  for (processor_t* proc : procs)
+    proc->save(out);
+  out.write(bool(clint));
+  if (clint)
+    clint->save(out);
+  debug_module.save(out);
+
+  out.close();
+}
+
+void sim_t::restore_checkpoint(const std::string& path)
+{
+  checkpoint_reader_t in(path.c_str());
+
+  in.read_tag("CONF");
+  bool match = in.read_string() == cfg->isa() &&
+               in.read_string() == cfg->priv() &&
+               in.read<uint64_t>() == procs.size() &&
+               in.read<uint64_t>() == mems.size();
+  for (size_t i = 0; match && i < mems.size(); i++) {
+    match = in.read<reg_t>() == mems[i].first &&
+            in.read<reg_t>() == mems[i].second->size();
+  }
+  if (!match)
+    throw std::runtime_error(path + " was written with a different --isa, --priv, -p or -m");
+
+  in.read_tag("SIM ");
+  current_step = in.read<size_t>();
+  current_proc = in.read<size_t>();
+  std::vector<fds_t::saved_fd_t> fds;
+  while (in.read<bool>()) {
+    fds_t::saved_fd_t fd;
+    fd.path = in.read_string();
+    fd.flags = in.read<int>();
+    fd.offset = in.read<int64_t>();
+    fds.push_back(fd);
+  }
+
+  // Memory goes first, as the harts drop their translations to the old pages
+  for (auto& mem : mems)
+    mem.second->restore(in);
+  debug_mmu->flush_tlb();
+  for (processor_t* proc : procs)
+    proc->restore(in);
+  if (in.read<bool>() != bool(clint))
+    throw std::runtime_error(path + " was written with a different DTB");
+  if (clint)
+    clint->restore(in);
+  debug_module.restore(in);
+
+  // Only reopen the target's files once everything else checks out
+  target_fds().restore(fds);
 }
 
 void sim_t::set_procs_debug(bool value)
@@ -275,6 +763,9 @@ bool sim_t::mmio_load(reg_t addr, size_t len, uint8_t* bytes)
 {
   if (addr + len < addr || !paddr_ok(addr + len - 1))
     return false;
+  std::unique_lock<std::mutex> guard(mmio_lock, std::defer_lock);
+  if (!hart_threads.empty())
+    guard.lock();
   return bus.load(addr, len, bytes);
 }
 
@@ -282,6 +773,9 @@ bool sim_t::mmio_store(reg_t addr, size_t len, const uint8_t* bytes)
 {
   if (addr + len < addr || !paddr_ok(addr + len - 1))
     return false;
+  std::unique_lock<std::mutex> guard(mmio_lock, std::defer_lock);
+  if (!hart_threads.empty())
+    guard.lock();
   return bus.store(addr, len, bytes);
 }
 
@@ -15,6 +15,10 @@
 #include "debug_module.h"
 #include "devices.h"
 #include "log_file.h"
+#include "commit_log.h"
+#include "log_writer.h"
+#include "bbv.h"
+#include "page_owners.h"
 #include "processor.h"
 #include "simif.h"
 
@@ -23,11 +27,32 @@
 #include <vector>
 #include <string>
 #include <memory>
+#include <map>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
 #include <sys/types.h>
 
 class mmu_t;
 class remote_bitbang_t;
 
+// Sampled simulation (--sample-interval).  The machine runs on the fast path
+// with logging and cache models off, and at each sample point forks a child,
+// which shares guest memory with it copy-on-write, to run the next length
+// instructions in detail while the parent carries on to the next point.
+struct sample_config_t
+{
+  reg_t start = 0;       // first sample point, in instructions retired by hart 0
+  reg_t interval = 0;    // instructions between sample points
+  reg_t length = 0;      // instructions each sample runs in detail
+  size_t count = 0;      // end the run after this many samples, if not 0
+  size_t jobs = 1;       // samples run at once
+  std::string output;    // sample k writes its stdout and stderr to output.k.out
+  std::vector<reg_t> points; // the sample points, in order, if not regular;
+                             // sample k is then the one at interval k
+};
+
 // this class encapsulates the processors and memory in a RISC-V machine.
 class sim_t : public htif_t, public simif_t
 {
@@ -48,14 +73,47 @@ public:
   int run();
   void set_debug(bool value);
   void set_histogram(bool value);
+  void set_jit(bool value);
 
   // Configure logging
   //
   // If enable_log is true, an instruction trace will be generated. If
-  // enable_commitlog is true, so will the commit results (if this
-  // build was configured without support for commit logging, the
-  // function will print an error message and abort).
-  void configure_log(bool enable_log, bool enable_commitlog);
+  // enable_commitlog is true, so will the commit results, in the compact
+  // binary format if commitlog_binary is also true.  If async is true, the
+  // log is formatted and written by a separate thread.
+  void configure_log(bool enable_log, bool enable_commitlog,
+                     bool commitlog_binary = false, bool async = false);
+
+  // Confine logging to a window.  The window may start at a symbol rather
+  // than at window.start_pc, which is looked up once the program is loaded.
+  void set_log_window(const log_window_t& window, const char* start_symbol);
+
+  // Write a checkpoint of the whole machine to path, and end the run, once
+  // hart 0 has retired instret instructions
+  void set_checkpoint_save(const char* path, reg_t instret);
+  // Resume from a checkpoint, rather than start the program afresh.  The
+  // program must still be given, and the options must match those of the
+  // run that wrote the checkpoint.
+  void set_checkpoint_restore(const char* path);
+
+  // Take samples, writing -l and --log-commits logs to log_path.k, if a log
+  // file was given, and tracing memory accesses with the sample memtracers
+  void configure_sampling(const sample_config_t& config);
+  void add_sample_memtracer(memtracer_t* tracer);
+
+  // Write a basic-block vector profile of each hart, to path, or to path.i
+  // for hart i if there are several, with a line every interval instructions
+  void configure_bbv(const char* path, reg_t interval);
+
+  // Run the harts on n host threads, hart i on thread i % n.  Each thread
+  // runs its harts for a quantum, and then waits for the others, so that
+  // time advances, and the devices are ticked, as when they run on one.
+  void set_hart_threads(size_t n);
+
+  // Make runs reproducible: run the harts in deterministic rounds (see
+  // page_owners_t), however many threads there are, and seed their entropy
+  // sources with seed, seed + 1, ...  Call before set_hart_threads.
+  void set_deterministic(uint64_t seed);
 
   void set_procs_debug(bool value);
   void set_remote_bitbang(remote_bitbang_t* remote_bitbang) {
@@ -83,7 +141,42 @@ private:
   std::unique_ptr<rom_device_t> boot_rom;
   std::unique_ptr<clint_t> clint;
   bus_t bus;
+  std::string log_path;
   log_file_t log_file;
+  std::unique_ptr<log_writer_t> log_writer;
+  std::unique_ptr<binary_commit_log_t> commit_log_bin;
+  bool log_window_enabled;
+  log_window_t log_window;
+  std::string log_window_symbol;
+  std::string checkpoint_save_path;
+  reg_t checkpoint_save_instret;
+  std::string checkpoint_restore_path;
+  bool sampling;
+  sample_config_t sample;
+  std::vector<memtracer_t*> sample_tracers;
+  size_t samples_taken;
+  reg_t next_sample;
+  bool in_sample;   // this is a sample's process
+  reg_t sample_end;
+  std::map<pid_t, size_t> sample_children;
+  std::vector<std::unique_ptr<bbv_profile_t>> bbv_profiles;
+  std::vector<std::thread> hart_threads; // all but the first group of harts
+  std::mutex round_lock;
+  std::condition_variable round_start;
+  std::atomic<size_t> rounds_started;
+  std::atomic<size_t> groups_running;
+  bool hart_threads_stopping; // guarded by round_lock
+  std::mutex mmio_lock;       // devices aren't thread-safe
+  std::unique_ptr<page_owners_t> page_owners; // in deterministic mode
+
+  // In deterministic mode, each hart logs to a buffer, which is copied to
+  // the log file after each phase of a round, in hart order
+  struct hart_log_t {
+    FILE* file;
+    char* buf;
+    size_t size;
+  };
+  std::vector<hart_log_t> hart_logs;
 
   FILE *cmd_file; // pointer to debug command input file
 
@@ -99,6 +192,12 @@ private:
 
   processor_t* get_core(const std::string& i);
   void step(size_t n); // step through simulation
+  void step_concurrently(); // one quantum of every hart, on the hart threads
+  void step_hart_group(size_t group);
+  void finish_round_serially();
+  void open_hart_logs();
+  void flush_hart_log(size_t i);
+  void hart_thread_main(size_t group);
   static const size_t INTERLEAVE = 5000;
   static const size_t INSNS_PER_RTC_TICK = 100; // 10 MHz clock for 1 BIPS core
   static const size_t CPU_HZ = 1000000000; // 1GHz CPU
@@ -107,6 +206,7 @@ private:
   bool debug;
   bool histogram_enabled; // provide a histogram of PCs
   bool log;
+  bool log_commits;
   remote_bitbang_t* remote_bitbang;
 
   // memory-mapped I/O routines
@@ -116,6 +216,18 @@ private:
   void make_dtb();
   void set_rom();
 
+  void save_checkpoint(const std::string& path);
+  void restore_checkpoint(const std::string& path);
+
+  // Things that happen when hart 0 has retired a given number of
+  // instructions.  handle_instret_events returns false to end the run.
+  reg_t next_instret_event();
+  bool handle_instret_events(reg_t retired);
+
+  void start_sample(reg_t retired);
+  void redirect_sample_output(size_t k, const std::vector<fds_t::saved_fd_t>& fds);
+  void wait_for_samples(size_t max_running);
+
   const char* get_symbol(uint64_t addr);
 
   // presents a prompt for introspection into the simulation
@@ -139,6 +251,7 @@ private:
   void interactive_until(const std::string& cmd, const std::vector<std::string>& args, bool noisy);
   void interactive_until_silent(const std::string& cmd, const std::vector<std::string>& args);
   void interactive_until_noisy(const std::string& cmd, const std::vector<std::string>& args);
+  void interactive_save(const std::string& cmd, const std::vector<std::string>& args);
   reg_t get_reg(const std::vector<std::string>& args);
   freg_t get_freg(const std::vector<std::string>& args);
   reg_t get_mem(const std::vector<std::string>& args);
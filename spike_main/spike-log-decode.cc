@@ -0,0 +1,73 @@
+// See LICENSE for license details.
+
+// This little program converts a binary commit log written with
+// --log-commits-binary back to the text form that --log-commits writes,
+// optionally keeping only instructions in a range of PCs.
+
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include "fesvr/option_parser.h"
+
+#include "commit_log.h"
+
+static void help(int exit_code = 1)
+{
+  fprintf(stderr, "usage: spike-log-decode [options] <binary commit log>\n");
+  fprintf(stderr, "Options:\n");
+  fprintf(stderr, "  --pc=<lo>:<hi>        Only print instructions with lo <= PC < hi\n");
+  fprintf(stderr, "  --offset=<n>          Start at the first sync record at or after\n");
+  fprintf(stderr, "                          byte offset n\n");
+  exit(exit_code);
+}
+
+static void suggest_help()
+{
+  fprintf(stderr, "Try 'spike-log-decode --help' for more information.\n");
+  exit(1);
+}
+
+int main(int argc, char** argv)
+{
+  reg_t pc_lo = 0, pc_hi = -1;
+  long offset = -1;
+
+  option_parser_t parser;
+  parser.help(&suggest_help);
+  parser.option('h', "help", 0, [&](const char* s){help(0);});
+  parser.option(0, "pc", 1, [&](const char* s){
+    char* end;
+    pc_lo = strtoull(s, &end, 0);
+    if (*end != ':')
+      help();
+    pc_hi = strtoull(end + 1, &end, 0);
+    if (*end)
+      help();
+  });
+  parser.option(0, "offset", 1, [&](const char* s){offset = strtol(s, 0, 0);});
+  auto argv1 = parser.parse(argv);
+
+  if (!*argv1 || argv1[1])
+    help();
+
+  FILE* in = fopen(*argv1, "rb");
+  if (!in) {
+    fprintf(stderr, "spike-log-decode: can't open %s\n", *argv1);
+    return 1;
+  }
+
+  try {
+    binary_commit_log_reader_t reader(in);
+    if (offset >= 0)
+      reader.seek(offset);
+    while (reader.next()) {
+      if (reader.pc() >= pc_lo && reader.pc() < pc_hi)
+        reader.print(stdout);
+    }
+  } catch (std::runtime_error& e) {
+    fprintf(stderr, "spike-log-decode: %s: %s\n", *argv1, e.what());
+    return 1;
+  }
+
+  return 0;
+}
@@ -10,10 +10,12 @@
 #include <fesvr/option_parser.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <vector>
 #include <string>
 #include <memory>
 #include <fstream>
+#include <algorithm>
 #include "../VERSION"
 
 static void help(int exit_code = 1)
@@ -50,6 +52,33 @@ static void help(int exit_code = 1)
   fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "                          The extlib flag for the library must come first.\n");
   fprintf(stderr, "  --log-cache-miss      Generate a log of cache miss\n");
+  fprintf(stderr, "  --log-commits         Generate a log of commit info\n");
+  fprintf(stderr, "  --log-commits-binary  Generate a compact binary log of commit info\n");
+  fprintf(stderr, "                          into the --log file; see spike-log-decode\n");
+  fprintf(stderr, "  --log-async           Format and write the --log file on a separate thread\n");
+  fprintf(stderr, "  --log-start-instret=<n> Start -l and --log-commits logging once a hart\n");
+  fprintf(stderr, "                          has retired n instructions\n");
+  fprintf(stderr, "  --log-start-pc=<pc>   Start logging once a hart reaches this address\n");
+  fprintf(stderr, "                          or symbol\n");
+  fprintf(stderr, "  --log-priv=<m|s|u>    Only log in these privilege modes, e.g. su\n");
+  fprintf(stderr, "  --log-length=<n>      Stop logging after n instructions per hart\n");
+  fprintf(stderr, "  --save-checkpoint=<path> Write the machine's state to path and exit\n");
+  fprintf(stderr, "  --checkpoint-instret=<n> ... once hart 0 has retired n instructions\n");
+  fprintf(stderr, "  --restore-checkpoint=<path> Resume from a checkpoint; give the same\n");
+  fprintf(stderr, "                          options and program as when it was saved\n");
+  fprintf(stderr, "  --sample-interval=<n> Fast-forward, and every n instructions of hart 0\n");
+  fprintf(stderr, "                          fork a sample that runs with -l, --log-commits\n");
+  fprintf(stderr, "                          and the cache models on\n");
+  fprintf(stderr, "  --sample-start=<n>    Take the first sample at instruction n [default 0]\n");
+  fprintf(stderr, "  --sample-length=<n>   Run each sample for n instructions [default: the interval]\n");
+  fprintf(stderr, "  --sample-count=<n>    Exit after taking n samples\n");
+  fprintf(stderr, "  --sample-jobs=<n>     Run up to n samples at once [default: number of CPUs]\n");
+  fprintf(stderr, "  --sample-output=<prefix> Write sample k's output to <prefix>.<k>.out, and\n");
+  fprintf(stderr, "                          its log to <--log file>.<k> [default sample]\n");
+  fprintf(stderr, "  --sample-points=<file> Sample only the intervals, --sample-interval long,\n");
+  fprintf(stderr, "                          chosen in a SimPoint .simpoints file\n");
+  fprintf(stderr, "  --bbv=<path>          Write a basic-block vector profile for SimPoint\n");
+  fprintf(stderr, "  --bbv-interval=<n>    ... with a vector every n instructions [default 100000000]\n");
   fprintf(stderr, "  --extension=<name>    Specify RoCC Extension\n");
   fprintf(stderr, "                          This flag can be used multiple times.\n");
   fprintf(stderr, "  --extlib=<name>       Shared library to load\n");
@@ -62,6 +91,11 @@ static void help(int exit_code = 1)
   fprintf(stderr, "  --initrd=<path>       Load kernel initrd into memory\n");
   fprintf(stderr, "  --bootargs=<args>     Provide custom bootargs for kernel [default: console=hvc0 earlycon=sbi]\n");
   fprintf(stderr, "  --real-time-clint     Increment clint time at real-time rate\n");
+  fprintf(stderr, "  --jit                 Translate hot RV64 integer code to host code\n");
+  fprintf(stderr, "  --hart-threads=<n>    Run the harts on n host threads [default 1]\n");
+  fprintf(stderr, "  --deterministic       Interleave the harts' memory accesses the same way\n");
+  fprintf(stderr, "                          in every run, however many --hart-threads\n");
+  fprintf(stderr, "  --seed=<n>            Seed the entropy source in deterministic mode [default 0]\n");
   fprintf(stderr, "  --dm-progsize=<words> Progsize for the debug module [default 2]\n");
   fprintf(stderr, "  --dm-sba=<bits>       Debug system bus access supports up to "
       "<bits> wide accesses [default 0]\n");
@@ -221,6 +255,34 @@ static unsigned long atoul_nonzero_safe(const char* s)
   return res;
 }
 
+// A SimPoint .simpoints file: one "<interval> <cluster>" line per point
+static std::vector<reg_t> read_simpoints(const char* path)
+{
+  std::ifstream in(path);
+  if (!in) {
+    fprintf(stderr, "can't open %s\n", path);
+    exit(-1);
+  }
+
+  std::vector<reg_t> intervals;
+  std::string line;
+  while (std::getline(in, line)) {
+    std::stringstream stream(line);
+    reg_t interval, cluster;
+    if (!(stream >> interval))
+      continue;
+    if (!(stream >> cluster)) {
+      fprintf(stderr, "%s is not a .simpoints file\n", path);
+      exit(-1);
+    }
+    intervals.push_back(interval);
+  }
+
+  std::sort(intervals.begin(), intervals.end());
+  intervals.erase(std::unique(intervals.begin(), intervals.end()), intervals.end());
+  return intervals;
+}
+
 static std::vector<int> parse_hartids(const char *s)
 {
   std::string const str(s);
@@ -241,6 +303,7 @@ int main(int argc, char** argv)
   bool debug = false;
   bool halted = false;
   bool histogram = false;
+  bool jit = false;
   bool log = false;
   bool socket = false;  // command line option -s
   bool dump_dts = false;
@@ -253,6 +316,24 @@ int main(int argc, char** argv)
   std::unique_ptr<cache_sim_t> l2;
   bool log_cache = false;
   bool log_commits = false;
+  bool log_commits_binary = false;
+  bool log_async = false;
+  bool log_window_enabled = false;
+  log_window_t log_window;
+  const char* log_start_symbol = nullptr;
+  const char* checkpoint_save_path = nullptr;
+  reg_t checkpoint_save_instret = 0;
+  const char* checkpoint_restore_path = nullptr;
+  bool sampling = false;
+  sample_config_t sample;
+  sample.jobs = std::max(sysconf(_SC_NPROCESSORS_ONLN), 1L);
+  sample.output = "sample";
+  const char* simpoints_path = nullptr;
+  const char* bbv_path = nullptr;
+  reg_t bbv_interval = 100000000;
+  size_t hart_threads = 1;
+  bool deterministic = false;
+  uint64_t seed = 0;
   const char *log_path = nullptr;
   std::vector<std::function<extension_t*()>> extensions;
   const char* initrd = NULL;
@@ -360,6 +441,10 @@ int main(int argc, char** argv)
   parser.option(0, "initrd", 1, [&](const char* s){initrd = s;});
   parser.option(0, "bootargs", 1, [&](const char* s){cfg.bootargs = s;});
   parser.option(0, "real-time-clint", 0, [&](const char *s){cfg.real_time_clint = true;});
+  parser.option(0, "jit", 0, [&](const char *s){jit = true;});
+  parser.option(0, "hart-threads", 1, [&](const char *s){hart_threads = atoul_nonzero_safe(s);});
+  parser.option(0, "deterministic", 0, [&](const char *s){deterministic = true;});
+  parser.option(0, "seed", 1, [&](const char *s){seed = strtoull(s, 0, 0);});
   parser.option(0, "extlib", 1, [&](const char *s){
     void *lib = dlopen(s, RTLD_NOW | RTLD_GLOBAL);
     if (lib == NULL) {
@@ -387,6 +472,55 @@ int main(int argc, char** argv)
       [&](const char* s){dm_config.support_haltgroups = false;});
   parser.option(0, "log-commits", 0,
                 [&](const char* s){log_commits = true;});
+  parser.option(0, "log-commits-binary", 0,
+                [&](const char* s){log_commits = log_commits_binary = true;});
+  parser.option(0, "log-async", 0,
+                [&](const char* s){log_async = true;});
+  parser.option(0, "log-start-instret", 1, [&](const char* s){
+    log_window_enabled = true;
+    log_window.start_instret = strtoull(s, 0, 0);
+  });
+  parser.option(0, "log-start-pc", 1, [&](const char* s){
+    log_window_enabled = true;
+    char* end;
+    log_window.start_pc = strtoull(s, &end, 0);
+    if (*end || end == s)
+      log_start_symbol = s;
+  });
+  parser.option(0, "log-priv", 1, [&](const char* s){
+    log_window_enabled = true;
+    for (const char* p = s; *p; p++) {
+      switch (*p) {
+        case 'm': case 'M': log_window.priv_mask |= 1 << PRV_M; break;
+        case 's': case 'S': log_window.priv_mask |= 1 << PRV_S; break;
+        case 'u': case 'U': log_window.priv_mask |= 1 << PRV_U; break;
+        default:
+          fprintf(stderr, "--log-priv takes a combination of m, s, and u\n");
+          exit(-1);
+      }
+    }
+  });
+  parser.option(0, "log-length", 1, [&](const char* s){
+    log_window_enabled = true;
+    log_window.length = strtoull(s, 0, 0);
+  });
+  parser.option(0, "save-checkpoint", 1, [&](const char* s){checkpoint_save_path = s;});
+  parser.option(0, "checkpoint-instret", 1, [&](const char* s){
+    checkpoint_save_instret = strtoull(s, 0, 0);
+  });
+  parser.option(0, "restore-checkpoint", 1, [&](const char* s){checkpoint_restore_path = s;});
+  parser.option(0, "sample-interval", 1, [&](const char* s){
+    sampling = true;
+    sample.interval = atoul_nonzero_safe(s);
+  });
+  parser.option(0, "sample-start", 1, [&](const char* s){sample.start = strtoull(s, 0, 0);});
+  parser.option(0, "sample-length", 1, [&](const char* s){sample.length = atoul_nonzero_safe(s);});
+  parser.option(0, "sample-count", 1, [&](const char* s){sample.count = atoul_nonzero_safe(s);});
+  parser.option(0, "sample-jobs", 1, [&](const char* s){sample.jobs = atoul_nonzero_safe(s);});
+  parser.option(0, "sample-output", 1, [&](const char* s){sample.output = s;});
+  parser.option(0, "sample-points", 1, [&](const char* s){simpoints_path = s;});
+  parser.option(0, "bbv", 1, [&](const char* s){bbv_path = s;});
+  parser.option(0, "bbv-interval", 1, [&](const char* s){bbv_interval = atoul_nonzero_safe(s);});
   parser.option(0, "log", 1,
                 [&](const char* s){log_path = s;});
   FILE *cmd_file = NULL;
@@ -410,6 +544,54 @@ int main(int argc, char** argv)
   if (!*argv1)
     help();
 
+  if (log_commits_binary && !log_path) {
+    fprintf(stderr, "--log-commits-binary requires --log\n");
+    exit(-1);
+  }
+
+  if (log_async && !log_path) {
+    fprintf(stderr, "--log-async requires --log\n");
+    exit(-1);
+  }
+
+  if (sampling && (debug || log_async || log_window_enabled)) {
+    fprintf(stderr, "--sample-interval can't be used with -d, --log-async "
+                    "or the --log-start, --log-priv and --log-length options\n");
+    exit(-1);
+  }
+  if (simpoints_path) {
+    if (!sampling) {
+      fprintf(stderr, "--sample-points requires --sample-interval\n");
+      exit(-1);
+    }
+    for (reg_t interval : read_simpoints(simpoints_path))
+      sample.points.push_back(interval * sample.interval);
+  }
+  if (!sample.length)
+    sample.length = sample.interval;
+
+  if (bbv_path && (debug || log || log_commits || histogram || sampling)) {
+    fprintf(stderr, "--bbv can't be used with -d, -l, -g, --log-commits "
+                    "or --sample-interval\n");
+    exit(-1);
+  }
+
+  if (hart_threads > 1 && (debug || ((log || log_commits) && !deterministic) ||
+                           ic || dc || checkpoint_save_path || sampling)) {
+    fprintf(stderr, "--hart-threads can't be used with -d, --ic, --dc, "
+                    "--save-checkpoint or --sample-interval, nor with -l or "
+                    "--log-commits unless --deterministic\n");
+    exit(-1);
+  }
+
+  if (deterministic && (debug || log_commits_binary || log_async || cfg.real_time_clint() ||
+                        checkpoint_save_path || sampling)) {
+    fprintf(stderr, "--deterministic can't be used with -d, --log-commits-binary, "
+                    "--log-async, --real-time-clint, --save-checkpoint or "
+                    "--sample-interval\n");
+    exit(-1);
+  }
+
   std::vector<std::pair<reg_t, mem_t*>> mems = make_mems(cfg.mem_layout());
 
   if (kernel && check_file_exists(kernel)) {
@@ -508,16 +690,33 @@ int main(int argc, char** argv)
   if (dc) dc->set_log(log_cache);
   for (size_t i = 0; i < cfg.nprocs(); i++)
   {
-    if (ic) s.get_core(i)->get_mmu()->register_memtracer(&*ic);
-    if (dc) s.get_core(i)->get_mmu()->register_memtracer(&*dc);
+    if (ic && !sampling) s.get_core(i)->get_mmu()->register_memtracer(&*ic);
+    if (dc && !sampling) s.get_core(i)->get_mmu()->register_memtracer(&*dc);
     for (auto e : extensions)
       s.get_core(i)->register_extension(e());
     s.get_core(i)->get_mmu()->set_cache_blocksz(blocksz);
   }
 
   s.set_debug(debug);
-  s.configure_log(log, log_commits);
+  s.configure_log(log, log_commits, log_commits_binary, log_async);
+  if (log_window_enabled)
+    s.set_log_window(log_window, log_start_symbol);
+  if (checkpoint_save_path)
+    s.set_checkpoint_save(checkpoint_save_path, checkpoint_save_instret);
+  if (checkpoint_restore_path)
+    s.set_checkpoint_restore(checkpoint_restore_path);
+  if (sampling) {
+    s.configure_sampling(sample);
+    if (ic) s.add_sample_memtracer(&*ic);
+    if (dc) s.add_sample_memtracer(&*dc);
+  }
+  if (bbv_path)
+    s.configure_bbv(bbv_path, bbv_interval);
   s.set_histogram(histogram);
+  s.set_jit(jit);
+  if (deterministic)
+    s.set_deterministic(seed);
+  s.set_hart_threads(hart_threads);
 
   auto return_code = s.run();
 